@@ -1,5 +1,9 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
+#include "QDKMemoryDialog.h"
+#include "QDKReplaceDialog.h"
+#include "QDKUsageDialog.h"
+#include "QDKTrace.h"
 
 #include <QtCore/QFile>
 #include <QtCore/QDataStream>
@@ -8,36 +12,78 @@
 #include <QFileDialog>
 #include <QInputDialog>
 #include <QShortcut>
+#include <QActionGroup>
 #include <QProgressBar>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow)
+    ui(new Ui::MainWindow),
+    memoryDialog(NULL),
+    usageDialog(NULL),
+    replaceDialog(NULL)
 {
+    QDKTraceScope trace("MainWindow");
+
     ui->setupUi(this);
     ui->lvlEdit->setupTileSelector(ui->tileSelect, 2.0f, 256);
 
     ui->actionOpen_ROM->setShortcut(QKeySequence::Open);
     ui->actionSave_ROM->setShortcut(QKeySequence::Save);
     ui->actionUndo->setShortcut(Qt::CTRL + Qt::Key_U);
+    ui->actionRedo->setShortcut(QKeySequence::Redo);
 
-    connect(ui->lvlEdit, SIGNAL(dataChanged()), this, SLOT(updateText()));
+    connect(ui->lvlEdit, SIGNAL(dataChanged(QTileChange)), this, SLOT(updateText(QTileChange)));
     connect(ui->tabWidget, SIGNAL(currentChanged(int)), ui->lvlEdit, SLOT(toggleSpriteMode(int)));
     connect(ui->tabWidget, SIGNAL(currentChanged(int)), this, SLOT(tabsSwitched(int)));
     connect(ui->btnWrite, SIGNAL(clicked()), ui->lvlEdit, SLOT(saveLevel()));
     connect(ui->actionOpen_ROM, SIGNAL(triggered()), this, SLOT(loadROM()));
     connect(ui->actionSave_ROM, SIGNAL(triggered()), this, SLOT(SaveROM()));
     connect(ui->actionUndo, SIGNAL(triggered()), ui->lvlEdit, SLOT(undo()));
+    connect(ui->actionRedo, SIGNAL(triggered()), ui->lvlEdit, SLOT(redo()));
     connect(ui->actionEmpty_Level, SIGNAL(triggered()), ui->lvlEdit, SLOT(clearLevel()));
     connect(ui->actionExportLvl, SIGNAL(triggered()), this, SLOT(ExportLvl()));
     connect(ui->actionImportLvl, SIGNAL(triggered()), this, SLOT(ImportLvl()));
 
+    // drawing tools for the tiles tab
+    QMenu *toolMenu = ui->menuEdit->addMenu("Tools");
+    QActionGroup *tools = new QActionGroup(this);
+    const char *toolNames[] = { "Pen", "Line", "Rectangle", "Fill", "Select" };
+    for (int i = TOOL_PEN; i <= TOOL_SELECT; i++)
+    {
+        QAction *action = toolMenu->addAction(toolNames[i]);
+        action->setCheckable(true);
+        action->setChecked(i == TOOL_PEN);
+        action->setData(i);
+        action->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_1 + i));
+        tools->addAction(action);
+    }
+    connect(tools, SIGNAL(triggered(QAction*)), this, SLOT(changeTool(QAction*)));
+
+    // regions marked with the select tool, the clipboard is kept across levels
+    QAction *actionCopy = ui->menuEdit->addAction("Copy region");
+    actionCopy->setShortcut(QKeySequence::Copy);
+    connect(actionCopy, SIGNAL(triggered()), ui->lvlEdit, SLOT(copySelection()));
+    QAction *actionPaste = ui->menuEdit->addAction("Paste region");
+    actionPaste->setShortcut(QKeySequence::Paste);
+    connect(actionPaste, SIGNAL(triggered()), ui->lvlEdit, SLOT(pasteSelection()));
+
+    QAction *actionUsage = ui->menuEdit->addAction("Find usage...");
+    actionUsage->setShortcut(QKeySequence::Find);
+    connect(actionUsage, SIGNAL(triggered()), this, SLOT(showUsage()));
+
+    QAction *actionReplace = ui->menuEdit->addAction("Replace in levels...");
+    actionReplace->setShortcut(QKeySequence::Replace);
+    connect(actionReplace, SIGNAL(triggered()), this, SLOT(showReplace()));
+
+    QAction *actionMemory = ui->menuEdit->addAction("Memory usage...");
+    connect(actionMemory, SIGNAL(triggered()), this, SLOT(showMemoryUsage()));
+
     connect(ui->lvlEdit, SIGNAL(musicChanged(int)), ui->cmbMusic, SLOT(setCurrentIndex(int)));
     connect(ui->lvlEdit, SIGNAL(paletteChanged(int)), ui->spbPalette, SLOT(setValue(int)));
     connect(ui->lvlEdit, SIGNAL(sizeChanged(int)), ui->cmbSize, SLOT(setCurrentIndex(int)));
     connect(ui->lvlEdit, SIGNAL(tilesetChanged(int)), ui->cmbTileset, SLOT(setCurrentIndex(int)));
     connect(ui->lvlEdit, SIGNAL(timeChanged(int)), ui->spbTime, SLOT(setValue(int)));
-    connect(ui->lvlEdit, SIGNAL(dataChanged()), this, SLOT(enableSaveBtn()));
+    connect(ui->lvlEdit, SIGNAL(dataChanged(QTileChange)), this, SLOT(enableSaveBtn(QTileChange)));
 
     connect(ui->spbLevel, SIGNAL(valueChanged(int)), this, SLOT(changeLevel(int)));
     connect(ui->cmbSize, SIGNAL(currentIndexChanged(int)), ui->lvlEdit, SLOT(changeSize(int)));
@@ -58,9 +104,10 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->lvlEdit, SIGNAL(tilesVRAMchanged(int)), this, SLOT(updateVRAMtiles(int)));
     connect(ui->lvlEdit, SIGNAL(spriteVRAMchanged(int)), this, SLOT(updateVRAMsprites(int)));
 
-    if ((qApp->arguments().size() > 1) && (QFile::exists(qApp->arguments().at(1))))
+    QStringList args = QDKTrace::stripArguments(qApp->arguments());
+    if ((args.size() > 1) && (QFile::exists(args.at(1))))
     {
-        ui->lvlEdit->loadAllLevels(qApp->arguments().at(1));
+        ui->lvlEdit->loadAllLevels(args.at(1));
         ui->lvlEdit->changeLevel(0);
         ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
     }
@@ -70,58 +117,79 @@ MainWindow::MainWindow(QWidget *parent) :
         ui->lvlEdit->changeLevel(0);
         ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
     }
+    restoreJournal();
     ui->tabWidget->setCurrentIndex(0);
     ui->spbLevel->setFocus();
 
+    // the sprites may still get built in the background
+    // so the menu is filled when it is opened for the first time
     QMenu *newSpriteMenu = new QMenu(this);
-    QDir dir("sprites/");
-    QStringList list = dir.entryList(QStringList("*.png"), QDir::Files, QDir::Name);
+    connect(newSpriteMenu, SIGNAL(aboutToShow()), this, SLOT(fillSpriteMenu()));
+
+    ui->toolButton->setMenu(newSpriteMenu);
+    connect(newSpriteMenu, SIGNAL(triggered(QAction*)), this, SLOT(addNewSprite(QAction*)));
+
+    QShortcut* scSprites = new QShortcut(QKeySequence(Qt::Key_Delete), ui->lstSprites);
+    connect(scSprites, SIGNAL(activated()), this, SLOT(removeSelectedSprite()));
+
+    QShortcut* scSwitches = new QShortcut(QKeySequence(Qt::Key_Delete), ui->treSwitches);
+    connect(scSwitches, SIGNAL(activated()), this, SLOT(delSwitchItem()));
+
+    changeLevel(0);
+}
+
+QIcon MainWindow::spriteIcon(int id)
+{
+    QImage img = ui->lvlEdit->spriteImage(id);
+    if (img.isNull())
+        return QIcon();
+
+    return QIcon(QPixmap::fromImage(img));
+}
+
+void MainWindow::fillSpriteMenu()
+{
+    QDKTraceScope trace("fillSpriteMenu");
+
+    QMenu *newSpriteMenu = ui->toolButton->menu();
+    if (!newSpriteMenu || !newSpriteMenu->isEmpty())
+        return;
 
     QAction *action;
-    QPixmap *pix;
+    QImage img;
     QPixmap pixLB(32, 32);
     qreal ar;
 
-    for (int i = 0; i < list.size(); i++)
+    for (int id = 0; id < 256; id++)
     {
-        pix = new QPixmap("sprites/" + list.at(i));
+        img = ui->lvlEdit->spriteImage(id);
+        if (img.isNull())
+            continue;
+
+        QPixmap pix = QPixmap::fromImage(img);
         pixLB.fill();
 
-        ar = (qreal)pix->width() / (qreal)pix->height();
+        ar = (qreal)pix.width() / (qreal)pix.height();
 
         if (ar >= 1.0f)
         {
             QPainter painter;
             painter.begin(&pixLB);
-            painter.drawPixmap(0, 16 - (16.0f/ar), pix->scaled(QSize(32, 32), Qt::KeepAspectRatio));
+            painter.drawPixmap(0, 16 - (16.0f/ar), pix.scaled(QSize(32, 32), Qt::KeepAspectRatio));
             painter.end();
         }
         else
         {
             QPainter painter;
             painter.begin(&pixLB);
-            painter.drawPixmap(16 - (16.0f*ar), 0, pix->scaled(QSize(32, 32), Qt::KeepAspectRatio));
+            painter.drawPixmap(16 - (16.0f*ar), 0, pix.scaled(QSize(32, 32), Qt::KeepAspectRatio));
             painter.end();
         }
-        delete pix;
 
-        action = new QAction(QIcon(pixLB), ui->lvlEdit->spriteNumToString(list.at(i).mid(7,2).toInt(0, 16)), newSpriteMenu);
-        action->setStatusTip(list.at(i).mid(7,2));
+        action = new QAction(QIcon(pixLB), ui->lvlEdit->spriteNumToString(id), newSpriteMenu);
+        action->setStatusTip(QString("%1").arg(id, 2, 16, QChar('0')));
         newSpriteMenu->addAction(action);
-        if (list.at(i).contains("set", Qt::CaseInsensitive))
-            i+=0x21;
     }
-
-    ui->toolButton->setMenu(newSpriteMenu);
-    connect(newSpriteMenu, SIGNAL(triggered(QAction*)), this, SLOT(addNewSprite(QAction*)));
-
-    QShortcut* scSprites = new QShortcut(QKeySequence(Qt::Key_Delete), ui->lstSprites);
-    connect(scSprites, SIGNAL(activated()), this, SLOT(removeSelectedSprite()));
-
-    QShortcut* scSwitches = new QShortcut(QKeySequence(Qt::Key_Delete), ui->treSwitches);
-    connect(scSwitches, SIGNAL(activated()), this, SLOT(delSwitchItem()));
-
-    changeLevel(0);
 }
 
 void MainWindow::tabsSwitched(int index)
@@ -234,10 +302,7 @@ void MainWindow::selectSprite(int num)
 
 void MainWindow::addSprite(QString text, int id)
 {
-    QString icon = QString("sprites/sprite_%1.png").arg(id, 2, 16, QChar('0'));
-    if (!QFile::exists(icon))
-        icon = QString("sprites/sprite_%1_set_00.png").arg(id, 2, 16, QChar('0'));
-    QListWidgetItem *item = new QListWidgetItem(QIcon(icon), text);
+    QListWidgetItem *item = new QListWidgetItem(spriteIcon(id), text);
     item->setToolTip(text);
     item->setStatusTip(QString("%1").arg(id, 2, 16, QChar('0')));
     ui->lstSprites->addItem(item);
@@ -250,7 +315,7 @@ void MainWindow::removeSprite(int index)
 }
 
 
-void MainWindow::changeLevel(int id)
+void MainWindow::askToSaveLevel()
 {
     if (ui->lvlEdit->isChanged())
     {
@@ -260,13 +325,20 @@ void MainWindow::changeLevel(int id)
         else if (result != QMessageBox::No) // discard changes
             qWarning() << "Unexpected return value form messagebox!";
     }
+}
+
+void MainWindow::changeLevel(int id)
+{
+    askToSaveLevel();
     ui->lvlEdit->changeLevel(id);
     ui->btnWrite->setEnabled(false);
 }
 
-void MainWindow::updateText()
+void MainWindow::updateText(const QTileChange &change)
 {
-    ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
+    // the info shows the stored level, edits don't change it
+    if (change.what & CHANGE_LEVEL)
+        ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
 }
 
 void MainWindow::loadROM()
@@ -279,6 +351,22 @@ void MainWindow::loadROM()
     ui->lvlEdit->loadAllLevels(file);
     ui->lvlEdit->changeLevel(0);
     ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
+    restoreJournal();
+}
+
+void MainWindow::restoreJournal()
+{
+    if (!ui->lvlEdit->hasJournal())
+        return;
+
+    QMessageBox::StandardButton result = QMessageBox::question(NULL, "Unsaved edits found", "Edits of an earlier session were not saved to this ROM. Restore them?", QMessageBox::Yes | QMessageBox::No);
+    if (result == QMessageBox::Yes)
+    {
+        ui->lvlEdit->replayJournal();
+        ui->lvlInfo->setPlainText(ui->lvlEdit->getLevelInfo());
+    }
+    else
+        ui->lvlEdit->discardJournal();
 }
 
 void MainWindow::SaveROM()
@@ -539,9 +627,10 @@ void MainWindow::delSwitchItem()
         ui->lvlEdit->deleteSwitchObj(item->parent()->indexOfChild(item));
 }
 
-void MainWindow::enableSaveBtn()
+void MainWindow::enableSaveBtn(const QTileChange &change)
 {
-    ui->btnWrite->setEnabled(true);
+    if (change.what & CHANGE_EDIT)
+        ui->btnWrite->setEnabled(true);
 }
 
 void MainWindow::updateVRAMtiles(int tiles)
@@ -594,3 +683,43 @@ void MainWindow::updateVRAMsprites(int sprites)
     if (ui->barVRAMtiles->value() > 80)
         updateVRAMtiles(ui->barVRAMtiles->value());
 }
+
+void MainWindow::showMemoryUsage()
+{
+    if (!memoryDialog)
+        memoryDialog = new QDKMemoryDialog(ui->lvlEdit, this);
+    else
+        memoryDialog->refresh();
+
+    memoryDialog->show();
+    memoryDialog->raise();
+}
+
+void MainWindow::showUsage()
+{
+    if (!usageDialog)
+    {
+        usageDialog = new QDKUsageDialog(ui->lvlEdit, this);
+        connect(usageDialog, SIGNAL(levelSelected(int)), ui->spbLevel, SLOT(setValue(int)));
+    }
+
+    usageDialog->show();
+    usageDialog->raise();
+}
+
+void MainWindow::showReplace()
+{
+    // the replacement works on the saved levels
+    askToSaveLevel();
+
+    if (!replaceDialog)
+        replaceDialog = new QDKReplaceDialog(ui->lvlEdit, this);
+
+    replaceDialog->show();
+    replaceDialog->raise();
+}
+
+void MainWindow::changeTool(QAction *action)
+{
+    ui->lvlEdit->setTool(action->data().toInt());
+}
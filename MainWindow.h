@@ -6,9 +6,14 @@
 #include <QTreeWidgetItem>
 #include <QAbstractButton>
 
+#include "QTileEdit.h"
+
 #define BASE_ROM "base.gb"
 
 struct QDKSwitch;
+class QDKMemoryDialog;
+class QDKUsageDialog;
+class QDKReplaceDialog;
 
 namespace Ui {
 class MainWindow;
@@ -25,21 +30,25 @@ public:
 private:
 //    void spriteContextMenu(QListWidgetItem *item, QPoint globalPos);
     void addSwitchAtPos(int i, QDKSwitch *sw);
+    QIcon spriteIcon(int id);
+    void restoreJournal();
+    void askToSaveLevel();
     
 private slots:
-    void updateText();
+    void updateText(const QTileChange &change);
 
     void changeLevel(int id);
     void loadROM();
     void SaveROM();
     void ExportLvl();
     void ImportLvl();
-    void enableSaveBtn();
+    void enableSaveBtn(const QTileChange &change);
     void selectSprite(int num);
     void addSprite(QString text, int id);
     void removeSelectedSprite();
     void removeSprite(int index);
     void addNewSprite(QAction *action);
+    void fillSpriteMenu();
     void addSwitch(QDKSwitch *sw);
     void updateSwitch(int i, QDKSwitch *sw);
     void removeSwitch(int i);
@@ -53,9 +62,16 @@ private slots:
     void delSwitchItem();
     void updateVRAMtiles(int tiles);
     void updateVRAMsprites(int sprites);
+    void showMemoryUsage();
+    void changeTool(QAction *action);
+    void showUsage();
+    void showReplace();
 
 private:
     Ui::MainWindow *ui;
+    QDKMemoryDialog *memoryDialog;
+    QDKUsageDialog *usageDialog;
+    QDKReplaceDialog *replaceDialog;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,197 @@
+#include "QDKAssetCache.h"
+#include "QDKTrace.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QtEndian>
+
+#include <string.h>
+
+QDKAssetCache::QDKAssetCache() :
+    data(NULL)
+{
+}
+
+QDKAssetCache::~QDKAssetCache()
+{
+    close();
+}
+
+bool QDKAssetCache::open(QString filename)
+{
+    QDKTraceScope trace("openAssetCache");
+
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = file.size();
+    if (size < ASSET_CACHE_HEADER_SIZE)
+    {
+        close();
+        return false;
+    }
+
+#if QT_VERSION >= 0x050400
+    // private mapping - QImage may write to the pixels without touching the file
+    data = file.map(0, size, QFileDevice::MapPrivateOption);
+#else
+    data = file.map(0, size);
+#endif
+
+    if (!data)
+    {
+        close();
+        return false;
+    }
+
+    if (memcmp(data, ASSET_CACHE_MAGIC, 4) || (qFromLittleEndian<quint32>(data + 4) != ASSET_CACHE_VERSION))
+    {
+        qWarning() << QString("Asset cache %1 is outdated and will be rebuilt").arg(filename);
+        close();
+        return false;
+    }
+
+    quint32 count = qFromLittleEndian<quint32>(data + 8);
+    if (ASSET_CACHE_HEADER_SIZE + (qint64)count * ASSET_CACHE_ENTRY_SIZE > size)
+    {
+        qWarning() << QString("Asset cache %1 is truncated and will be rebuilt").arg(filename);
+        close();
+        return false;
+    }
+
+    // the index just gets turned into pointers to the mapped pixels
+    const uchar *entry = data + ASSET_CACHE_HEADER_SIZE;
+    QDKAssetEntry asset;
+    quint32 key, offset;
+
+    for (quint32 i = 0; i < count; i++)
+    {
+        key = qFromLittleEndian<quint32>(entry);
+        asset.width = qFromLittleEndian<quint16>(entry + 4);
+        asset.height = qFromLittleEndian<quint16>(entry + 6);
+        offset = qFromLittleEndian<quint32>(entry + 8);
+        asset.hash = qFromLittleEndian<quint64>(entry + 12);
+        entry += ASSET_CACHE_ENTRY_SIZE;
+
+        if (offset + (qint64)asset.width * asset.height > size)
+        {
+            qWarning() << QString("Asset cache %1: entry 0x%2 is out of range!").arg(filename).arg(key, 8, 16, QChar('0'));
+            close();
+            return false;
+        }
+
+        asset.pixels = data + offset;
+        index.insert(key, asset);
+    }
+
+    return true;
+}
+
+void QDKAssetCache::close()
+{
+    index.clear();
+
+    if (data)
+    {
+        file.unmap(data);
+        data = NULL;
+    }
+
+    file.close();
+}
+
+bool QDKAssetCache::contains(quint32 key, quint64 hash) const
+{
+    QHash<quint32, QDKAssetEntry>::const_iterator it = index.constFind(key);
+
+    // entries built from different rom data are outdated
+    return (it != index.constEnd()) && (it.value().hash == hash);
+}
+
+QImage QDKAssetCache::image(quint32 key, const QVector<QRgb> &colors) const
+{
+    QHash<quint32, QDKAssetEntry>::const_iterator it = index.constFind(key);
+    if (it == index.constEnd())
+        return QImage();
+
+    // no copy - the image uses the mapped pixels directly
+#if QT_VERSION >= 0x050400
+    QImage img(it.value().pixels, it.value().width, it.value().height, it.value().width, QImage::Format_Indexed8);
+#else
+    QImage img((const uchar *)it.value().pixels, it.value().width, it.value().height, it.value().width, QImage::Format_Indexed8);
+#endif
+    img.setColorTable(colors);
+
+    return img;
+}
+
+qint64 QDKAssetCache::mappedSize() const
+{
+    return data ? file.size() : 0;
+}
+
+bool QDKAssetCache::isMapped(const uchar *pixels) const
+{
+    return data && (pixels >= data) && (pixels < data + file.size());
+}
+
+bool QDKAssetCache::write(QString filename, const QMap<quint32, QImage> &images, const QHash<quint32, quint64> &hashes)
+{
+    QMap<quint32, QImage> entries;
+    QMap<quint32, QImage>::const_iterator i;
+
+    for (i = images.constBegin(); i != images.constEnd(); ++i)
+        if (!i.value().isNull() && (i.value().format() == QImage::Format_Indexed8))
+            entries.insert(i.key(), i.value());
+
+    QFile out(filename);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream stream(&out);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    stream.writeRawData(ASSET_CACHE_MAGIC, 4);
+    stream << (quint32)ASSET_CACHE_VERSION;
+    stream << (quint32)entries.size();
+    stream << (quint32)0x00;
+
+    quint32 offset = ASSET_CACHE_HEADER_SIZE + entries.size() * ASSET_CACHE_ENTRY_SIZE;
+    for (i = entries.constBegin(); i != entries.constEnd(); ++i)
+    {
+        offset = (offset + 3) & ~3;
+        stream << i.key();
+        stream << (quint16)i.value().width();
+        stream << (quint16)i.value().height();
+        stream << offset;
+        stream << hashes.value(i.key());
+        offset += i.value().width() * i.value().height();
+    }
+
+    for (i = entries.constBegin(); i != entries.constEnd(); ++i)
+    {
+        while (out.pos() % 4)
+            stream << (quint8)0x00;
+
+        for (int y = 0; y < i.value().height(); y++)
+            stream.writeRawData((const char *)i.value().constScanLine(y), i.value().width());
+    }
+
+    out.close();
+
+    return (stream.status() == QDataStream::Ok);
+}
+
+quint32 QDKAssetCache::tilesetKey(int id)
+{
+    return (0x00 << 16) | (id & 0xFF);
+}
+
+quint32 QDKAssetCache::spriteKey(int id, int set)
+{
+    // set -1: sprite is the same for all tilesets
+    return (0x01 << 16) | ((id & 0xFF) << 8) | (set & 0xFF);
+}
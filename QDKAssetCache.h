@@ -0,0 +1,54 @@
+#ifndef QDKASSETCACHE_H
+#define QDKASSETCACHE_H
+
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtGui/QImage>
+
+#define ASSET_CACHE "eDKit.cache"
+#define ASSET_CACHE_MAGIC "eDKC"
+#define ASSET_CACHE_VERSION 2
+
+/* file layout (little endian):
+   header: magic (4) | version (4) | entry count (4) | reserved (4)
+   index:  key (4) | width (2) | height (2) | offset (4) | source hash (8)   for every entry
+   data:   8bit colour indices of every entry, one byte per pixel,
+           each entry starts at a 4 byte boundary
+*/
+#define ASSET_CACHE_HEADER_SIZE 16
+#define ASSET_CACHE_ENTRY_SIZE 20
+
+struct QDKAssetEntry
+{
+    quint16 width;
+    quint16 height;
+    quint64 hash; // of the rom data the entry was built from
+    uchar *pixels; // points into the mapped file
+};
+
+class QDKAssetCache
+{
+public:
+    QDKAssetCache();
+    ~QDKAssetCache();
+
+    bool open(QString filename);
+    void close();
+    bool contains(quint32 key, quint64 hash) const;
+    QImage image(quint32 key, const QVector<QRgb> &colors) const;
+    qint64 mappedSize() const;
+    bool isMapped(const uchar *pixels) const;
+
+    static bool write(QString filename, const QMap<quint32, QImage> &images, const QHash<quint32, quint64> &hashes);
+
+    static quint32 tilesetKey(int id);
+    static quint32 spriteKey(int id, int set);
+
+private:
+    QFile file;
+    uchar *data;
+    QHash<quint32, QDKAssetEntry> index;
+};
+
+#endif // QDKASSETCACHE_H
@@ -1,51 +1,26 @@
 #include "QDKEdit.h"
+#include "QDKTrace.h"
+#include "QDKJournal.h"
 #include <QtCore/QDebug>
 #include "MainWindow.h"
+#include "QGBTileDecoder.h"
 #include "QTileSelector.h"
-#include <QtCore/QDir>
-#include <QtGui/QBitmap>
+#include <QtCore/QBuffer>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QtEndian>
+#include <QtConcurrentRun>
 #include <QtGui/QMouseEvent>
 
-bool QDKEdit::isSprite[] = {
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, true , false, false, false, false, false,
-    false, false, false, false, true , false, false, true ,
-    true , false, false, false, false, true , true , true ,
-    true , false, false, false, true , false, false, true ,
-    true , false, true , false, true , false, true , false,
-    false, false, false, false, true , false, false, false,
-    false, false, false, false, false, false, true , false,
-    true, false, true, false, false, false, false, false,
-    false, false, true , false, true , false, false, true ,
-    true , false, false, false, true , false, true , false,
-    true , false, true , false, false, false, true , false,
-    true , false, true , false, true , false, true , false,
-    true , false, true , false, false, true , false, false,
-    false, false, true , false, true , false, true , false,
-    true , false, true , false, true , false, true , false,
-    true , false, false, false, false, false, true , false,
-    true , false, true , false, false, false, true , false,
-    true , false, true , false, false, false, true , false,
-    true , false, true , false, true , false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false,
-    false, false, false, false, false, false, false, false
-};
-
-
 QDKEdit::QDKEdit(QWidget *parent) :
-    QTileEdit(parent), switchMode(false), switchToEdit(-1), romLoaded(false), vramTiles(0), vramSprites(0)
+    QTileEdit(parent), switchMode(false), switchToEdit(-1), romLoaded(false), vramTiles(0), vramSprites(0), historyBytes(0), journalPaused(false),
+    tileToMove(-1)
 {
+    QDKTraceScope trace("QDKEdit");
+
     currentLevel = -1;
+    currentRender = NULL;
+    currentRenderKey = 0;
+    renderCache.setMaxCost(RENDER_CACHE_SIZE);
     dataIsChanged = false;
     tileDataIs16bit = true;
     spriteContext = false;
@@ -68,930 +43,453 @@ QDKEdit::QDKEdit(QWidget *parent) :
 
     // read all tilesets
     // these are just the "fallback" colours
-    QGBPalette palette;
-    palette[0] = Qt::white;
-    palette[1] = Qt::black;
-    palette[2] = Qt::yellow;
-    palette[3] = Qt::red;
+    fallbackColors << QColor(Qt::white).rgb() << QColor(Qt::black).rgb() << QColor(Qt::yellow).rgb() << QColor(Qt::red).rgb();
 
     transparentSprites = true;
 
     QFile baseRom(BASE_ROM);
     baseRom.open(QIODevice::ReadOnly);
-    getTileInfo(&baseRom);
-    createTileSets(&baseRom, palette);
-    createSprites(&baseRom, palette);
-    readSGBPalettes(&baseRom);
+    baseRomData = baseRom.readAll();
     baseRom.close();
 
-    loadTileSet("tiles/tileset_00.png", 0xFF, 704);
+    QBuffer rom(&baseRomData);
+    rom.open(QIODevice::ReadOnly);
+    getTileInfo(&rom);
+    readSGBPalettes(&rom);
+    hashAssetSources(&rom);
+    rom.close();
+
+    packSGBPalettes();
+
+    // tilesets and sprites come from the asset cache if possible
+    // everything else is built in the background
+    // tilesets are only built once a level uses them
+    assetsBuilt = false;
+    assetCache.open(ASSET_CACHE);
+    createTileSets();
+    createSprites();
+
+    // the real tileset is set by the first updateTileset
+    QPixmap emptySet(128, 352);
+    emptySet.fill(Qt::white);
+    setTileSet(emptySet, 0xFF, 704);
 
     getMouse(true);
     connect(this, SIGNAL(singleTileChanged(int,int,int)), this, SLOT(checkForLargeTile(int,int,int)));
     connect(this, SIGNAL(flagByteChanged(int)), this, SLOT(updateSprite(int)));
-    connect(this, SIGNAL(dataChanged()), this, SLOT(calcVRAMusage()));
+    connect(this, SIGNAL(dataChanged(QTileChange)), this, SLOT(updateVRAMusage(QTileChange)));
 }
 
 QDKEdit::~QDKEdit()
 {
-    qDeleteAll(spritePix);
+    // the jobs still reference tiles[] and the rom data
+    for (int i = 0; i < MAX_TILESETS; i++)
+        tilesetJobs[i].waitForFinished();
+    for (int i = 0; i <= MAX_TILESETS; i++)
+        spriteJobs[i].waitForFinished();
+
+    if (assetsBuilt)
+        writeAssetCache();
+
+    delete currentRender;
     qDeleteAll(spriteImg);
 }
 
-bool QDKEdit::saveAllLevels(QString romFile)
+void QDKEdit::hashTileSource(QCryptographicHash *hash, QIODevice *src, quint8 tileID, quint8 tileSetID, int dataSize)
 {
-    QFile rom(romFile);
-    if (!rom.exists())
-        QFile::copy(BASE_ROM, romFile);
-
-    rom.open(QIODevice::ReadWrite);
-
-    QDataStream out(&rom);
-    out.setByteOrder(QDataStream::LittleEndian);
-
-    // make sure current "opened" level is writen back
-    changeLevel(currentLevel);
-
-    // get used rom banks and limits
-    quint8 rombank[3];
-    quint8 rombankLimit[2];
-    quint8 currentBank;
-    quint16 pointer;
-
-    rombank[0] = ROMBANK_1;
-
-    rom.seek(ROMBANK_POS_2);
-    out >> rombank[1];
-
-    rom.seek(ROMBANK_POS_3);
-    out >> rombank[2];
-
-    rom.seek(POINTER_TABLE + (MAX_LEVEL_ID * 2));
-    currentBank = 0;
-
-    for (int i = 0; i < LAST_LEVEL; i++)
-    {
-        // recompress level data - this checks wheather it was changed
-        recompressLevel(i);
-
-        // check if the rom bank is full
-        pointer = (rom.pos() % 0x4000) + 0x4000;
-
-        if ((pointer + levels[i].fullData.size()) > 0x8000)
-        {
-            if (currentBank > 1)
-            {
-                qWarning() << QString("Level %1: No more free space for level data! Aborting!").arg(i);
-                rom.close();
-                return false;
-            }
-
-            // remember new rombank limit
-            rombankLimit[currentBank] = i;
-            currentBank++;
-
-            rom.seek(rombank[currentBank] * 0x4000);
-            pointer = (rom.pos() % 0x4000) + 0x4000;
-        }
-
-        // update rom bank and offset
-        levels[i].rombank = rombank[currentBank];
-        levels[i].offset = rom.pos();
-
-        // write level data
-        if (rom.write(levels[i].fullData) != levels[i].fullData.size())
-        {
-            qWarning() << QString("Writing level %1 failed! Aborting!").arg(i);
-            rom.close();
-            return false;
-        }
-    }
-
-    //write SGB palettes for all levels
-    for (int i = 0; i < LAST_LEVEL; i++)
-        if (i < 4) // this may cause the game to freeze for "high" palette values !
-        {
-            rom.seek(PAL_ARCADE + (i * 6));
-            out << (quint8)(levels[i].paletteIndex - 0x180 + 0xC8);
-        }
-        else
-        {
-            rom.seek(PAL_TABLE + ((i-4) * 6));
-            out << (quint8)(levels[i].paletteIndex - 0x180);
-        }
+    quint32 offset = tileDataOffset(src, tileID, tileSetID);
 
+    QByteArray info;
+    QDataStream out(&info, QIODevice::WriteOnly);
+    out << tileID << tiles[tileID].w << tiles[tileID].h << tiles[tileID].count;
+    out << tiles[tileID].compressed << tiles[tileID].additionalTilesAt << offset;
+    hash->addData(info);
 
-    // write new pointers back to the table
-    rom.seek(POINTER_TABLE);
-    for (int i = 0; i < LAST_LEVEL; i++)
-        out << (quint16)(levels[i].offset % 0x4000 + 0x4000);
-
-    for (int i = LAST_LEVEL; i < MAX_LEVEL_ID; i++)
-        out << (quint16)(levels[LAST_LEVEL].offset % 0x4000 + 0x4000);
-
-    // correct rombank limits
-    rom.seek(COMPARE_POS_1);
-    out << rombankLimit[0];
-
-    rom.seek(COMPARE_POS_2);
-    out << rombankLimit[1];
-
-    // fix checksum
-    rom.seek(0);
-    quint16 chksum = 0;
-    quint16 orgChksum;
-    quint8 headerchksum = 0;
-    quint8 orgHeader = 0;
-    quint8 byte;
-    for (quint32 i = 0; i < rom.size(); i++)
-    {
-        out >> byte;
-        if (i < 0x0134)
-                chksum += (quint16)byte;
-        else if (i < 0x014D)
-        {
-            chksum += (quint16)byte;
-            headerchksum += byte;
-        }
-        else if (i == 0x014D)
-            orgHeader = byte;
-        else if (i == 0x014E)
-            orgChksum = (((quint16)byte) << 8);
-        else if (i == 0x014F)
-            orgChksum |= (quint16)byte;
-        else
-            chksum += (quint16)byte;
-    }
-
-    headerchksum = (quint8)(0xE7 - headerchksum);
-    if (headerchksum != orgHeader)
-    {
-        rom.seek(0x014D);
-        out << headerchksum;
-        qWarning() << QString("Header checksum was incorrect (0x%1 -> 0x%2)! Are you using a corrupted ROM?!").arg(orgHeader, 4, 16, QChar('0')).arg(headerchksum, 4, 16, QChar('0'));
-    }
-    chksum += (quint16)headerchksum;
-    if (chksum != orgChksum)
-    {
-        rom.seek(0x014E);
-        out.setByteOrder(QDataStream::BigEndian);
-        out << chksum;
-        out.setByteOrder(QDataStream::LittleEndian);
-    }
-
-    /*qDebug() << QString("Header checksum: 0x%1").arg(orgHeader, 2, 16, QChar('0'));
-    qDebug() << QString("Calc header: 0x%1").arg(headerchksum, 2, 16, QChar('0'));
-    qDebug() << QString("Global checksum: 0x%1").arg(orgChksum, 4, 16, QChar('0'));
-    qDebug() << QString("Calc global: 0x%1").arg(chksum, 4, 16, QChar('0'));*/
-
-    rom.close();
-
-    return true;
+    // compressed data is at most 9/8 of its decompressed size
+    hash->addData(baseRomData.mid(offset, dataSize + dataSize/8 + 1));
 }
 
-bool QDKEdit::loadAllLevels(QString romFile)
+void QDKEdit::hashAssetSources(QIODevice *src)
 {
-    bool allOkay = true;
-
-    QFile rom(romFile);
-    rom.open(QIODevice::ReadOnly);
-
-    QDataStream in(&rom);
-    in.setByteOrder(QDataStream::LittleEndian);
+    QDKTraceScope trace("hashAssetSources");
 
-    // we first get the three used rom banks from the asm code
-    // the first bank (0x05) contains MAX_LEVEL_ID 16bit pointers
-    // everything else is available for level data
+    // every cache entry gets a hash of the tile info and rom data it is built from
+    // so only entries whose source changed are rebuilt for a different base rom
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    QByteArray result;
 
-    //get used rom banks and limits
-    quint8 rombank[3];
-    quint8 rombankLimit[2];
-    quint8 bank;
-    quint16 pointer;
-
-    rombank[0] = ROMBANK_1;
-
-    rom.seek(ROMBANK_POS_2);
-    in >> rombank[1];
-
-    rom.seek(ROMBANK_POS_3);
-    in >> rombank[2];
-
-    rom.seek(COMPARE_POS_1);
-    in >> rombankLimit[0];
-
-    rom.seek(COMPARE_POS_2);
-    in >> rombankLimit[1];
-
-    //read pointers
-    rom.seek(POINTER_TABLE);
-    for (int i = 0; i < MAX_LEVEL_ID; i++)
+    for (int id = 0; id < MAX_TILESETS; id++)
     {
-        if (i < rombankLimit[0])
-            bank = 0;
-        else if (i < rombankLimit[1])
-            bank = 1;
-        else
-            bank = 2;
-
-        in >> pointer;
+        hash.reset();
+        for (int i = 0; i < 255; i++)
+            hashTileSource(&hash, src, i, id, GB_TILE_BYTES*tiles[i].count);
 
-        levels[i].id = i;
-        levels[i].rombank = rombank[bank];
-        levels[i].offset = (rombank[bank] - 1 ) * 0x4000 + pointer;
-        levels[i].fullDataUpToDate = false;
-
-        //qDebug() << QString("Level %1 -- Rombank %2 -- Offset 0x%3").arg(i).arg(levels[i].rombank).arg(levels[i].offset, 6, 16, QChar('0'));
+        result = hash.result();
+        assetHashes.insert(QDKAssetCache::tilesetKey(id), qFromLittleEndian<quint64>((const uchar *)result.constData()));
     }
 
-    //read raw data
-    for (int i = 0; i < MAX_LEVEL_ID; i++)
-        if (!readLevel(&rom, i))
-            allOkay = false;
-
-    rom.close();
-
-    romLoaded = allOkay;
-
-    return allOkay;
-}
-
-bool QDKEdit::readLevel(QFile *src, quint8 id, bool fromLvlFile)
-{    
-    QDataStream in(src);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    quint8 byte, flag;
-    quint16 address;
-
-    if (!fromLvlFile)
-        src->seek(levels[id].offset);
-    else
-        src->seek(1);
-
-    in >> levels[id].size;
-    in >> levels[id].music;
-    in >> levels[id].tileset;
-    in >> levels[id].time;
-
-    // switch data
-    levels[id].rawSwitchData.clear();
-    in >> byte;
-    if (byte == 0x00)
-        levels[id].switchData = false;
-    else
+    for (int id = 0; id < 256; id++)
     {
-        levels[id].switchData = true;
-        levels[id].rawSwitchData.append(byte);
-        for (int i = 0; i < 0x10; i++) // 1 byte already read!
-        {
-            in >> byte;
-            levels[id].rawSwitchData.append(byte);
-        }
-
-        //0x90 bytes codiert
-        bool secondRound = false;
+        if (!isSprite[id])
+            continue;
 
-        while (levels[id].rawSwitchData.size() < 0xA1)
+        for (int set = -1; set < MAX_TILESETS; set++)
         {
-            if (secondRound)
-                in >> byte;
-            else
-                secondRound = true;
-
-            flag = byte;
-            byte = 0x00;
-            if (flag < 0x80)
-                for (int i = 0; i < flag; i++)
-                    levels[id].rawSwitchData.append(byte);
-            else
-            {
-                flag &= 0x7F;
-                for (int i = 0; i < flag; i++)
-                {
-                    in >> byte;
-                    levels[id].rawSwitchData.append(byte);
-                }
-            }
-        }
-
-        if (levels[id].rawSwitchData.size() != 0xA1)
-            qWarning() << QString("Level %1: incorrect size of switch data! size: %2").arg(id).arg(levels[id].rawSwitchData.size());
-    }
-
-    // additional sprite data?
-    levels[id].rawAddSpriteData.clear();
-    in >> byte;
-    if (byte == 0x00)
-        levels[id].addSpriteData = false;
-    else
-    {
-        levels[id].addSpriteData = true;
-
-        bool secondRound = false;
+            if (tiles[id].setSpecific != (set >= 0))
+                continue;
 
-        //0x40 bytes codiert
-        while (levels[id].rawAddSpriteData.size() < 0x40)
-        {
-            if (secondRound)
-                in >> byte;
-            else
-                secondRound = true;
+            // enough for the whole sprite and the extra tiles some sprites have
+            hash.reset();
+            hashTileSource(&hash, src, id, set, GB_TILE_BYTES*(qMax(tiles[id].w*tiles[id].h, (int)tiles[id].count) + 2));
 
-            flag = byte;
-            byte = 0x00;
-            if (flag < 0x80)
-                for (int i = 0; i < flag; i++)
-                    levels[id].rawAddSpriteData.append(byte);
-            else
-            {
-                flag &= 0x7F;
-                for (int i = 0; i < flag; i++)
-                {
-                    in >> byte;
-                    levels[id].rawAddSpriteData.append(byte);
-                }
-            }
+            result = hash.result();
+            assetHashes.insert(QDKAssetCache::spriteKey(id, set), qFromLittleEndian<quint64>((const uchar *)result.constData()));
         }
-
-        if (levels[id].rawAddSpriteData.size() != 0x40)
-            qWarning() << QString("Level %1: incorrect size of add. sprite data! size: %2").arg(id).arg(levels[id].rawAddSpriteData.size());
     }
+}
 
-    //LZSS compressed tilemap
-    quint16 uncompressedSize;
+bool QDKEdit::assetCached(quint32 key)
+{
+    return assetCache.contains(key, assetHashes.value(key));
+}
 
-    if (levels[id].size == 0x00)
-        uncompressedSize = 0x240;
-    else
-        uncompressedSize = 0x380;
+bool QDKEdit::writeAssetCache()
+{
+    QDKTraceScope trace("writeAssetCache");
 
-    levels[id].rawTilemap = LZSSDecompress(&in, uncompressedSize);
-    expandRawTilemap(id);
+    QString tmpFile = QString(ASSET_CACHE) + ".tmp";
+    bool written;
 
-    //sprite data
-    levels[id].sprites.clear();
-    in >> byte;
-    while (byte != 0x00)
     {
-        QDKSprite sprite;
-        sprite.id = byte;
-        in >> sprite.ramPos;
-        sprite.levelPos = sprite.ramPos - 0xDA75;
-        sprite.pixelPerfect = false;
-        sprite.x = sprite.levelPos % 32;
-        sprite.y = sprite.levelPos / 32;
-        sprite.sprite = NULL;
-        sprite.rotate = BOTTOM;
-        sprite.flagByte = getSpriteDefaultFlag(byte);
-        sprite.size = QSize(tiles[byte].w, tiles[byte].h);
+        QMap<quint32, QImage> images;
+        QImage *img;
 
-        if (sprite.id == 0x54)
-            sprite.drawOffset.setX(-0.5f);
-
-        levels[id].sprites.append(sprite);
-
-        in >> byte;
-    }
-
-    if (levels[id].sprites.size() > MAX_SPRITES)
-        qWarning() << QString("Level %1: too many sprites! count: %2").arg(id).arg(levels[id].sprites.size());
-
-    if (levels[id].addSpriteData)
-    {
-        for (int i = 0; i < levels[id].rawAddSpriteData.size(); i+=4)
+        // tilesets which were never opened are carried over from the old cache
+        for (int id = 0; id < MAX_TILESETS; id++)
         {
-            byte = (quint8)levels[id].rawAddSpriteData[i];
-
-            //asm @ 0x46E6 rombank 0x0C
-            //missing keyholes from lvl95 0xB8 - flag only 00 or 01?
-            //missing DK sprites 9A 6E CC - flag only 00 or 01 ?
-            // 9A handled like 80 98 84
-            // 6E CC handled identical
-
-            // the original game contains much garbage btw...
-
-            if ((byte != 0x7F) && (byte != 0x98) && (byte != 0x80) && (byte != 0x54) && (byte != 0x70) && (byte != 0x72) &&
-                (byte != 0x84) && (byte != 0xB8) && (byte != 0x9A) && (byte != 0x6E) && (byte != 0xCC))
-                continue;
-
-            address = (quint8)levels[id].rawAddSpriteData[i+1] + (0x100 * (quint8)levels[id].rawAddSpriteData[i+2]);
-            flag = (quint8)levels[id].rawAddSpriteData[i+3];
-
-            // elevator actually correspondes to a tile
-            if ((byte == 0x70) || (byte == 0x72))
+            if (tilesetRequested[id])
             {
-                if (byte == (quint8)levels[id].rawTilemap[address - 0xD44D])
-                {
-                    //we found a correct tile
-                    //so we need a new sprite
-                    QDKSprite sprite;
-                    sprite.id = byte;
-                    sprite.ramPos = address;
-                    sprite.levelPos = sprite.ramPos - 0xD44D;
-                    sprite.pixelPerfect = false;
-                    sprite.x = sprite.levelPos % 32;
-                    sprite.y = sprite.levelPos / 32;
-                    sprite.sprite = NULL;
-                    sprite.rotate = BOTTOM;
-                    sprite.flagByte = flag;
-                    sprite.size = QSize(tiles[byte].w, tiles[byte].h);
-                    levels[id].sprites.append(sprite);
-
-                }
-
-                continue;
+                waitForTileset(id);
+                images.insert(QDKAssetCache::tilesetKey(id), tilesets[id]);
             }
-
-            // these sprites may get mirrored
-            for (int j = 0; j < levels[id].sprites.size(); j++)
-                if (levels[id].sprites.at(j).ramPos == address)
-                {
-                    levels[id].sprites[j].flagByte = flag;
-
-                    //actually the game engine takes 0x7F sprite properties
-                    //without checking the RAM address...
-                    if (byte == 0x7F)
-                        levels[id].sprites[j].rotate = flag;
-                    else if ((byte == 0x80) || (byte == 0x98))
-                        levels[id].sprites[j].rotate = ((flag+1) & 1);
-                    break;
-                }
+            else if (assetCached(QDKAssetCache::tilesetKey(id)))
+                images.insert(QDKAssetCache::tilesetKey(id), assetCache.image(QDKAssetCache::tilesetKey(id), fallbackColors));
         }
-    }
-
-    for (int t = 0; t < levels[id].switches.size(); t++)
-        levels[id].switches[t].connectedTo.clear();
 
-    levels[id].switches.clear();
-    if (levels[id].switchData)
-    {
-        for (int i = 8; i > 0; i--)
+        for (int set = -1; set < MAX_TILESETS; set++)
         {
-            if (!(levels[id].rawSwitchData[0] & (1 << (i-1))))
-                continue;
-
-            QDKSwitch newSwitch;
-            quint8 connectedObjectFlags = levels[id].rawSwitchData[i];
-            newSwitch.state = levels[id].rawSwitchData[8+i];
-            newSwitch.ramPos = (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18)] + (0x100 * (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + 1]);
-            newSwitch.levelPos = newSwitch.ramPos - 0xD44D;
-            newSwitch.x = newSwitch.levelPos % 0x20;
-            newSwitch.y = newSwitch.levelPos / 0x20;
-
-            for (int j = 8; j > 0; j--)
+            waitForSprites(set);
+            for (int id = 0; id < 256; id++)
             {
-                if (!(connectedObjectFlags & (1 << (j-1))))
+                if (!isSprite[id] || (tiles[id].setSpecific != (set >= 0)))
                     continue;
 
-                QDKSwitchObject newObj;
-                newObj.ramPos = (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + (2*j)] + (0x100 * (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + (2*j) + 1]);
-                if (newObj.ramPos < 0xDA00) //tile
-                {
-                    newObj.isSprite = false;
-                    newObj.levelPos = newObj.ramPos - 0xD44D;
-                }
-                else
-                {
-                    newObj.isSprite = true;
-                    newObj.levelPos = newObj.ramPos - 0xDA75;
-                }
-
-                newObj.x = newObj.levelPos % 0x20;
-                newObj.y = newObj.levelPos / 0x20;
-
-                newSwitch.connectedTo.append(newObj);
+                img = spriteImg.value(spriteKey(id, set), NULL);
+                if (img)
+                    images.insert(QDKAssetCache::spriteKey(id, set), *img);
             }
-
-            levels[id].switches.append(newSwitch);
         }
-    }
 
-    //copy the full raw data
-    //no need to recompress if level data needs to be relocated
-    quint32 size;
-    if (!fromLvlFile)
-    {
-        size = src->pos() - levels[id].offset;
-        src->seek(levels[id].offset);
-    }
-    else
-    {
-        size = src->size() - 1;
-        src->seek(1);
+        written = QDKAssetCache::write(tmpFile, images, assetHashes);
     }
 
-    //get palette number
-    levels[id].fullData.clear();
-    for (quint32 i = 0; i < size; i++)
-    {
-        in >> byte;
-        levels[id].fullData.append(byte);
-    }
-
-    if (fromLvlFile)
-    {
-        src->seek(0);
-        in >> byte;
-    }
-    else if (id < 4)
-    {
-        src->seek(PAL_ARCADE + (id * 6));
-        in >> byte;
-        byte -= 0xC8;
-    }
-    else
-    {
-        src->seek(PAL_TABLE + (id-4)*8);
-        in >> byte;
-    }
-
-    levels[id].paletteIndex = 0x180 + byte;
+    // nothing may use the mapped file anymore before it gets replaced
+    for (int id = 0; id < MAX_TILESETS; id++)
+        tilesets[id] = QImage();
+    qDeleteAll(spriteImg);
+    spriteImg.clear();
+    assetCache.close();
 
-    if (levels[id].paletteIndex >= 0x200)
+    if (!written)
     {
-        if (id <= LAST_LEVEL)
-            qWarning() << QString("Level %1: invalid SGB palette 0x%2! default to 0x180").arg(id).arg(levels[id].paletteIndex, 4, 16, QChar('0'));
-        levels[id].paletteIndex = 0x180;
+        qWarning() << QString("Could not write asset cache %1").arg(tmpFile);
+        QFile::remove(tmpFile);
+        return false;
     }
 
-    levels[id].fullDataUpToDate = true;
-
-    if ((quint8)levels[id].fullData[size-1] != (quint8)0x00)
-        qWarning() << QString("Level %1: last byte of raw data is not 0x00! byte %2; size %3").arg(id).arg(levels[id].fullData[size-1], 2, 16, QChar('0')).arg(size);
-
-    return true;
+    QFile::remove(ASSET_CACHE);
+    return QFile::rename(tmpFile, ASSET_CACHE);
 }
 
-bool QDKEdit::readSGBPalettes(QFile *src)
+bool QDKEdit::loadAllLevels(QString romFile)
 {
-    src->seek(SGB_SYSTEM_PAL);
-    QDataStream in(src);
-    in.setByteOrder(QDataStream::LittleEndian);
+    QDKTraceScope trace("loadAllLevels");
 
-    quint16 color;
-    int rgb;
-    QColor tmp;
+    QFile file(romFile);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
 
-//    Bit 0-4   - Red Intensity   (0-31)
-//    Bit 5-9   - Green Intensity (0-31)
-//    Bit 10-14 - Blue Intensity  (0-31)
-//    Bit 15    - Not used (zero)
+    QByteArray data = file.readAll();
+    file.close();
 
-    QByteArray decompressed = LZSSDecompress(&in, 0x1000);
+    QBuffer rom(&data);
+    rom.open(QIODevice::ReadOnly);
+    romLoaded = readAllLevels(&rom);
+    rom.close();
 
-    QDataStream pal(decompressed);
-    pal.setByteOrder(QDataStream::LittleEndian);
+    usage.build(this);
 
-    for (int i = 0; i < 512; i++)
-    {
-        for (int j = 0; j < 4; j++)
-        {
-            pal >> color;
-            rgb = (color & 0x1F)* 8;
-            if (rgb == 248)
-                rgb = 255;
-            tmp.setRed(rgb);
-            rgb = ((color >> 5) & 0x1F) * 8;
-            if (rgb == 248)
-                rgb = 255;
-            tmp.setGreen(rgb);
-            rgb = ((color >> 10) & 0x1F) * 8;
-            if (rgb == 248)
-                rgb = 255;
-            tmp.setBlue(rgb);
-            sgbPal[i][j] = tmp;
-        }
-    }
+    // the histories belong to the levels of the previous rom
+    currentLevel = -1;
+    clearLevelHistories();
 
-    return true;
+    // edits that never made it into this rom
+    journal.open(romFile, QCryptographicHash::hash(data, QCryptographicHash::Md5));
+    pendingJournal = journal.records();
+
+    return romLoaded;
 }
 
-void QDKEdit::rebuildSwitchData(int id)
+bool QDKEdit::saveAllLevels(QString romFile)
 {
-    QDKLevel *lvl = &levels[id];
-
-    lvl->rawSwitchData.clear();
-
-    if (lvl->switches.isEmpty())
-    {
-        lvl->switchData = false;
-        return;
-    }
+    QFile rom(romFile);
+    if (!rom.exists())
+        QFile::copy(BASE_ROM, romFile);
 
-    lvl->switchData = true;
+    if (!rom.open(QIODevice::ReadWrite))
+        return false;
 
-    lvl->rawSwitchData.fill((quint8)0x00, 0x11 + 0x90);
+    // make sure current "opened" level is writen back
+    changeLevel(currentLevel);
 
-    int switchCount, objCount;
-    switchCount = lvl->switches.size();
+    bool result = writeAllLevels(&rom);
 
-    if (switchCount > 8)
+    QByteArray written;
+    if (result)
     {
-        qWarning() << QString("Level %1: More than 8 switches found! Truncated to 8!").arg(id);
-        switchCount = 8;
+        rom.flush();
+        rom.seek(0);
+        written = rom.readAll();
     }
+    rom.close();
 
-    for (int i = 0; i < switchCount; i++)
+    // everything journaled is in the saved rom now
+    // later edits belong to the rom as it was just written
+    if (result)
     {
-        //switch state
-        lvl->rawSwitchData[i + 9] = lvl->switches.at(switchCount-i-1).state;
-        //switch address
-        lvl->rawSwitchData[17 + (i * 18)] = (quint8)(lvl->switches.at(switchCount-i-1).ramPos % 0x100);
-        lvl->rawSwitchData[17 + (i * 18) + 1] = (quint8)(lvl->switches.at(switchCount-i-1).ramPos / 0x100);
-
-        objCount = lvl->switches.at(switchCount-i-1).connectedTo.size();
-        if (objCount > 8)
-        {
-            qWarning() << QString("Level %1: More than 8 connected objects for switch %2! Truncated to 8!").arg(id).arg(switchCount-i-1);
-            objCount = 8;
-        }
-
-        for (int j = 0; j < objCount; j++)
-        {
-            //object addresses
-            lvl->rawSwitchData[17 + (i * 18) + (2*j) + 2] = (quint8)(lvl->switches.at(switchCount-i-1).connectedTo.at(objCount-j-1).ramPos % 0x100);
-            lvl->rawSwitchData[17 + (i * 18) + (2*j) + 3] = (quint8)(lvl->switches.at(switchCount-i-1).connectedTo.at(objCount-j-1).ramPos / 0x100);
-        }
-        //object use flag
-        lvl->rawSwitchData[i + 1] = (1 << lvl->switches.at(switchCount-i-1).connectedTo.size()) - 1;
+        journal.clear();
+        journal.open(romFile, QCryptographicHash::hash(written, QCryptographicHash::Md5));
     }
-    //switch use flag
-    lvl->rawSwitchData[0] = (1 << lvl->switches.size()) - 1;
+
+    return result;
 }
 
-void QDKEdit::rebuildAddSpriteData(int id)
+void decodeTileToImage(const uchar *src, QImage *img, int x, int y)
 {
-    QDKLevel *lvl = &levels[id];
+    QGBTileDecoder::decodeTile(src, img->bits(), img->width(), img->height(), img->bytesPerLine(), x, y);
+}
 
-    lvl->rawAddSpriteData.clear();
-    lvl->rawAddSpriteData.fill((quint8)0x00, 0x40);
-    lvl->addSpriteData = true;
+static inline int sgbIntensity(quint16 value)
+{
+    value &= 0x1F;
+    return (value == 0x1F) ? 255 : value * 8;
+}
 
-    int flagCount = 0;
+void QDKEdit::packSGBPalettes()
+{
+    quint16 color;
 
-    for (int i = lvl->sprites.size() - 1; i >= 0; i--)
-    {
-        if (lvl->sprites.at(i).flagByte != getSpriteDefaultFlag(lvl->sprites.at(i).id))
+    for (int i = 0; i < 512; i++)
+        for (int j = 0; j < 4; j++)
         {
-            if (flagCount >= 0x20)
-            {
-                qWarning() << QString("Level %1: More than 32 sprites with initialized flag byte! Truncated to 32!").arg(id);
-                break;
-            }
-
-            //check for elevator in tilemap
-            if ((lvl->sprites.at(i).id == 0x70) || (lvl->sprites.at(i).id == 0x72))
-                if (lvl->rawTilemap[lvl->sprites.at(i).levelPos] != lvl->sprites.at(i).id)
-                    continue;
-
-            //IdLo HiFb
-            lvl->rawAddSpriteData[flagCount * 4] = (quint8)lvl->sprites.at(i).id;
-            lvl->rawAddSpriteData[flagCount * 4 + 1] = (quint8)(lvl->sprites.at(i).ramPos % 0x100);
-            lvl->rawAddSpriteData[flagCount * 4 + 2] = (quint8)(lvl->sprites.at(i).ramPos / 0x100);
-            lvl->rawAddSpriteData[flagCount * 4 + 3] = (quint8)lvl->sprites.at(i).flagByte;
-
-            flagCount++;
+            color = sgbPalettes[i][j];
+            sgbPal[i][j] = qRgb(sgbIntensity(color), sgbIntensity(color >> 5), sgbIntensity(color >> 10));
         }
-    }
+}
 
-    if (!flagCount)
-    {
-        lvl->rawAddSpriteData.clear();
-        lvl->addSpriteData = false;
-    }
+QVector<QRgb> QDKEdit::paletteTable(quint16 palIndex, quint8 paletteByte)
+{
+    // BGP/OBP: two bits per colour index select the palette entry
+    const QRgb *pal = sgbPal[palIndex];
+    QVector<QRgb> table(4);
+    table[0] = pal[paletteByte & 0x03];
+    table[1] = pal[(paletteByte >> 2) & 0x03];
+    table[2] = pal[(paletteByte >> 4) & 0x03];
+    table[3] = pal[(paletteByte >> 6) & 0x03];
+
+    return table;
 }
 
 bool QDKEdit::exportCurrentLevel(QString filename)
 {
     saveLevel();
-    recompressLevel(currentLevel);
 
     QFile file(filename);
-
-    file.open(QIODevice::WriteOnly);
-
-    QDataStream out(&file);
-    out.setByteOrder(QDataStream::LittleEndian);
-    // palette
-    quint8 pal = (quint8)(levels[currentLevel].paletteIndex - 0x180);
-    out << pal;
-
-    // write level data
-    if (file.write(levels[currentLevel].fullData) != levels[currentLevel].fullData.size())
-    {
-        qWarning() << QString("Writing level %1 failed! Aborting!").arg(currentLevel);
-        file.close();
+    if (!file.open(QIODevice::WriteOnly))
         return false;
-    }
 
+    bool result = exportLevel(currentLevel, &file);
     file.close();
 
-    return true;
+    return result;
 }
 
 bool QDKEdit::importLevel(QString filename)
 {
     QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray data = file.readAll();
+    file.close();
 
-    file.open(QIODevice::ReadOnly);
-    if (!file.exists())
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    if (!importLevel(&buffer))
         return false;
 
+    if (!journalPaused)
+        journal.append(JOURNAL_LEVEL, currentLevel, data);
+
+    return true;
+}
+
+bool QDKEdit::importLevel(QIODevice *src)
+{
     switchToEdit = -1;
     swObjToMove = -1;
     spriteSelection = QRect();
     spriteToMove = -1;
 
-    if (!readLevel(&file, currentLevel, true))
+    if (!readLevel(src, currentLevel, true))
         return false;
 
-    file.close();
+    usage.updateLevel(this, currentLevel);
+
     dataIsChanged = false;
+
+    // the history doesn't match the imported level
+    clearUndoData();
     changeLevel(currentLevel);
 
     return true;
 }
 
-bool QDKEdit::recompressLevel(quint8 id)
+bool QDKEdit::hasJournal()
 {
-    QDKLevel *lvl = &levels[id];
-    quint8 byte;
-    quint8 count;
+    return !pendingJournal.isEmpty();
+}
 
-    if (lvl->fullDataUpToDate)
-        return true;
+int QDKEdit::replayJournal()
+{
+    QDKTraceScope trace("replayJournal");
 
-    // drop 16bit tiles
-    updateRawTilemap(id);
+    if (!romLoaded || pendingJournal.isEmpty())
+        return 0;
 
-    //rebuild sprite properties aka additional sprite data
-    rebuildAddSpriteData(id);
+    int orgLevel = (currentLevel != -1) ? currentLevel : 0;
+    int count = 0;
+    quint8 size, music, tileset;
+    quint16 time, palIndex;
 
-    //rebuild switch connections
-    rebuildSwitchData(id);
+    // replayed edits are already in the journal
+    journalPaused = true;
 
-    // delete old data
-    lvl->fullData.clear();
-
-    // simple values
-    lvl->fullData.append(lvl->size);
-    lvl->fullData.append(lvl->music);
-    lvl->fullData.append(lvl->tileset);
-    byte = lvl->time % 0x100;
-    lvl->fullData.append(byte);
-    byte = lvl->time / 0x100;
-    lvl->fullData.append(byte);
-
-    // switch data
-    if (!lvl->switchData)
-        lvl->fullData.append(QChar(0x00));
-    else
+    for (int i = 0; i < pendingJournal.size(); i++)
     {
-        count = 0;
-        byte = 0;
-
-        // copy the first 0x11 bytes uncompressed
-        for (int i = 0; i < 0x11; i++)
-            lvl->fullData.append((quint8)lvl->rawSwitchData[i]);
+        const QDKJournalRecord &record = pendingJournal.at(i);
 
-        for (int i = 0x11; i < lvl->rawSwitchData.size(); i++) //compress the remaining bytes
+        if (record.level != currentLevel)
         {
-            count = 0;
-
-            while (((quint8)lvl->rawSwitchData[i] == (quint8)0x00) && (count < 0x7F) && (i < lvl->rawSwitchData.size()))
-            {
-                count++;
-                i++;
-            }
-
-            if (count != 0)
-            {
-                lvl->fullData.append(count);
-                count = 0;
-                i--;
-                continue;
-            }
-
-            while (((quint8)lvl->rawSwitchData[i] != (quint8)0x00) && (count < 0x7F) && (i < lvl->rawSwitchData.size()))
-            {
-                count++;
-                i++;
-            }
-
-            if (count != 0)
-            {
-                byte = 0x80 + count;
-                lvl->fullData.append(byte);
-                i--;
-
-                for (int j = 0; j < count; j++)
-                    lvl->fullData.append((quint8)lvl->rawSwitchData[i-count+1+j]);
-
-                count = 0;
-            }
-
+            saveLevel();
+            changeLevel(record.level);
         }
-        if (count != 0)
-            qWarning() << QString("Level %1: recompressing switch data; count == %2").arg(id).arg(count);
-    }
-
 
+        QByteArray data = record.data;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
 
-    if (!lvl->addSpriteData)
-        lvl->fullData.append(QChar(0x00));
-    else // compress additional sprite data (same as above)
-    {
-        count = 0;
-        byte = 0;
-
-        for (int i = 0; i < lvl->rawAddSpriteData.size(); i++)
+        switch (record.type)
         {
-            count = 0;
-
-            while (((quint8)lvl->rawAddSpriteData[i] == (quint8)0x00) && (count < 0x7F) && (i < lvl->rawAddSpriteData.size()))
+            case JOURNAL_STEP:
+            case JOURNAL_UNDO:
             {
-                count++;
-                i++;
-            }
+                QTileEditStep *step = newUndoStep();
+                step->read(&in);
+                applyUndoStep(step, record.type == JOURNAL_UNDO);
+                delete step;
 
-            if (count != 0)
-            {
-                lvl->fullData.append(count);
-                count = 0;
-                i--;
-                continue;
+                // becomes a step of the level history again
+                commitUndoStep();
+                dataIsChanged = true;
+                break;
             }
+            case JOURNAL_PROPERTIES:
+                in >> size >> music >> tileset >> time >> palIndex;
+                changeSize(size);
+                changeMusic(music);
+                changeTileset(tileset);
+                changeTime(time);
+                changePalette(palIndex);
+                break;
+            case JOURNAL_LEVEL:
+                importLevel(&buffer);
+                break;
+            default:
+                qWarning() << QString("Journal: unknown record type %1").arg(record.type);
+                continue;
+        }
 
-            while (((quint8)lvl->rawAddSpriteData[i] != (quint8)0x00) && (count < 0x7F) && (i < lvl->rawAddSpriteData.size()))
-            {
-                count++;
-                i++;
-            }
+        count++;
+    }
 
-            if (count != 0)
-            {
-                byte = 0x80 + count;
-                lvl->fullData.append(byte);
-                i--;
+    saveLevel();
+    journalPaused = false;
+    pendingJournal.clear();
 
-                for (int j = 0; j < count; j++)
-                    lvl->fullData.append((quint8)lvl->rawAddSpriteData[i-count+1+j]);
+    changeLevel(orgLevel);
 
-                count = 0;
-            }
-        }
-        if (count != 0)
-            qWarning() << QString("Level %1: recompressing sprite flag; count == %2").arg(id).arg(count);
-    }
+    return count;
+}
 
-    // compress tilemap
-    lvl->fullData.append(LZSSCompress(&lvl->rawTilemap));
+void QDKEdit::discardJournal()
+{
+    pendingJournal.clear();
+    journal.clear();
+}
 
-    // add sprite tiles+ram position
-    for (int i = 0; i < lvl->sprites.size(); i++)
-    {
-        // do not add the pseudo elevator sprite
-        if ((lvl->sprites.at(i).id == 0x70) || (lvl->sprites.at(i).id == 0x72))
-            continue;
+void QDKEdit::journalUndoStep(const QTileEditStep *step, bool undo)
+{
+    if (journalPaused || (currentLevel == -1))
+        return;
 
-        lvl->fullData.append((quint8)lvl->sprites.at(i).id);
-        byte = lvl->sprites.at(i).ramPos % 0x100;
-        lvl->fullData.append(byte);
-        byte = lvl->sprites.at(i).ramPos / 0x100;
-        lvl->fullData.append(byte);
-    }
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    step->write(&out);
 
-    // 0x00 marks level end
-    lvl->fullData.append(QChar(0x00));
+    journal.append(undo ? JOURNAL_UNDO : JOURNAL_STEP, currentLevel, data);
+}
 
-    lvl->fullDataUpToDate = true;
+void QDKEdit::journalProperties(int id, quint8 size, quint8 music, quint8 tileset, quint16 time, quint16 palIndex)
+{
+    if (journalPaused || (id == -1))
+        return;
 
-    /*QFile file("recompessed.lvl");
-    file.open(QIODevice::WriteOnly);
-    file.write(lvl->fullData);
-    file.close();*/
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out << size << music << tileset << time << palIndex;
 
-    return true;
+    journal.append(JOURNAL_PROPERTIES, id, data);
 }
 
-bool QDKEdit::updateRawTilemap(quint8 id)
+void QDKEdit::checkForLargeTile(int x, int y, int drawnTile)
 {
-    levels[id].rawTilemap.clear();
-    for (int i = 0; i < levels[id].displayTilemap.size(); i+=2)
-    {
-        if ((quint8)levels[id].displayTilemap[i+1] == 0x00)
-            levels[id].rawTilemap.append((quint8)levels[id].displayTilemap[i]);
-        else
-            levels[id].rawTilemap.append((quint8)0xFF);
-    }
+    expandTile(x, y, drawnTile);
+}
 
-    return true;
+QSize QDKEdit::tileFootprint(int tileNumber)
+{
+    if ((tileNumber < 0) || (tileNumber > 0xFF) || (tiles[tileNumber].count <= 1))
+        return QSize(1, 1);
+
+    return QSize(tiles[tileNumber].w, tiles[tileNumber].h);
 }
 
-void QDKEdit::checkForLargeTile(int x, int y, int drawnTile)
+// writes the additional tiles of a super tile drawn at x,y
+void QDKEdit::expandTile(int x, int y, int tileNumber)
 {
-    if (drawnTile == emptyTile)
+    if ((tileNumber == emptyTile) || (tileNumber < 0) || (tileNumber > 0xFF))
         return;
 
     int i = y * levelDimension.width() + x;
@@ -999,486 +497,338 @@ void QDKEdit::checkForLargeTile(int x, int y, int drawnTile)
     if ((x < 0) || (y < 0) || (i*2 >= lvlData.size()) || ((int)lvlData[i*2] == emptyTile))
         return;
 
-    if (tiles[tileToDraw].count > 1)
+    if (tiles[tileNumber].count > 1)
     {
-        int tilePos = 0x100 + tiles[tileToDraw].additionalTilesAt;
+        int tilePos, cell, owner;
 
-        for (int j = 0; j < tiles[tileToDraw].h; j++)
-            for (int k = 0; k < tiles[tileToDraw].w; k++)
+        for (int j = 0; j < tiles[tileNumber].h; j++)
+            for (int k = 0; k < tiles[tileNumber].w; k++)
             {
                 if (!k && !j)
                     continue;
 
-                lvlData[lvlDataStart + (i+k+(j*0x20))*2] = (tilePos & 0xFF);
-                lvlData[lvlDataStart + (i+k+(j*0x20))*2 + 1] = (tilePos >> 8);
-                tilePos++;
+                // parts are numbered row by row without the top left cell
+                tilePos = 0x100 + tiles[tileNumber].additionalTilesAt + j*tiles[tileNumber].w + k - 1;
+                cell = i+k+(j*0x20);
+                if ((x+k >= levelDimension.width()) || (lvlDataStart + cell*2 + 1 >= lvlData.size()))
+                    continue;
+
+                // a tile only partly covered would leave orphan parts
+                owner = anchorAt(cell);
+                if ((owner != -1) && (owner != i))
+                    eraseTile(owner);
+
+                lvlData[lvlDataStart + cell*2] = (tilePos & 0xFF);
+                lvlData[lvlDataStart + cell*2 + 1] = (tilePos >> 8);
+                if (cell < anchors.size())
+                    anchors[cell] = i;
             }
     }
 }
 
-bool QDKEdit::expandRawTilemap(quint8 id)
+void QDKEdit::rebuildAnchors()
 {
-    levels[id].displayTilemap.clear();
+    int width = levelDimension.width();
+    int cellCount = lvlData.size() / 2;
+    int tile, tilePos, cell;
 
-    //expand to 16bit for additional tiles
-    for (int i = 0; i < levels[id].rawTilemap.size(); i++)
-    {
-        levels[id].displayTilemap.append((quint8)levels[id].rawTilemap[i]);
-        levels[id].displayTilemap.append(QChar(0x00));
-    }   
-
-    quint8 tileID;
-    quint16 tilePos;    
+    anchors.fill(-1, cellCount);
 
-    // expand super tiles
-    for (int i = 0; i < levels[id].rawTilemap.size(); i++)
+    for (int i = 0; i < cellCount; i++)
     {
-        tileID = levels[id].rawTilemap[i];
-        if (tileID == 0xFF)
+        tile = getTile(i);
+        if ((tile == emptyTile) || (tile < 0) || (tile > 0xFF))
             continue;
 
-        if (tiles[tileID].count > 1)
-        {
-            tilePos = 0x100 + tiles[tileID].additionalTilesAt;
-
-            for (int j = 0; j < tiles[tileID].h; j++)
-                for (int k = 0; k < tiles[tileID].w; k++)
-                {
-                    if (!k && !j)
-                        continue;
-
-                    levels[id].displayTilemap[(i+k+(j*0x20))*2] = (tilePos & 0xFF);
-                    levels[id].displayTilemap[(i+k+(j*0x20))*2 + 1] = (tilePos >> 8);
-                    tilePos++;
-                }
-        }
-    }
-
-    return true;
-}
-
-void QDKEdit::copyTileToSet(QFile *src, quint32 offset, QImage *img, quint16 tileID, quint8 tileSetID = 0, bool compressed = false, quint8 tileCount = 1, quint16 superOffset = 0)
-{       
-    QDataStream *in;
-    quint16 tileX, tileY, pointer;
-    quint8 low, high, pixel, firstSet, secondSet;
-    QByteArray decompressed;
-
-    if (tiles[tileID].setSpecific)
-    {
-        QDataStream tmp(src);
-
-        // get the two sub tilesets offsets
-        // rombank 0xC offset 0x4EEB is a table of two offsets for every tileset
-        tmp.setByteOrder(QDataStream::LittleEndian);
-        src->seek(SUBTILESET_TABLE + (tileSetID*2));
-
-        tmp >> firstSet;
-        tmp >> secondSet;
-
-        // this is finally the last pointer before the actual tile data...
-        // here are the "same" tiles from different tilesets grouped together
-        if ((tileID < 0xCD) || (tileID == 0xFD))
-            src->seek(offset + firstSet);
-        else
-            src->seek(offset + secondSet);
-
-        tmp >> pointer;
-
-        src->seek(offset + pointer);
-    }
-    else
-        src->seek(offset);
-
-    if (compressed)
-    {
-        QDataStream decomp(src);
-        decompressed = LZSSDecompress(&decomp, 0x10*tileCount);
-        in = new QDataStream(decompressed);
-    }
-    else
-        in = new QDataStream(src);
+        anchors[i] = i;
 
+        if (tiles[tile].count <= 1)
+            continue;
 
-    in->setByteOrder(QDataStream::LittleEndian);
-
-    for (int t = 0; t < tileCount; t++)
-    {
-        tileY = (tileID / 16) * 8;
-        tileX = (tileID % 16) * 8;
-
-        for (int i = 0; i < 8; i++)
-        {
-            (*in) >> low;
-            (*in) >> high;
-
-            for (int j = 0; j < 8; j++)
+        // only the parts still matching the expansion belong to the tile
+        for (int j = 0; j < tiles[tile].h; j++)
+            for (int k = 0; k < tiles[tile].w; k++)
             {
-                pixel = low & 0x80;
-                pixel >>= 1;
-                pixel |= high & 0x80;
-                pixel >>= 6;
-
-                low <<= 1;
-                high <<= 1;
-
-                img->setPixel(tileX+j, tileY+i, pixel);
-            }
-        }
-
-        tileID = 0x100 + superOffset + t;
-    }
-
-    delete in;
-}
-
-bool QDKEdit::getTileInfo(QFile *src)
-{
-    QDataStream in(src);
-    in.setByteOrder(QDataStream::LittleEndian);
-
-    quint16 pointer;
-    quint8 bank, tilesCount;
-    quint32 offset;
-    quint16 addOffset = 0;
-    quint8 byte;
+                cell = i + k + j*width;
+                if ((!k && !j) || (i % width + k >= width) || (cell >= cellCount))
+                    continue;
 
-    for (int i = 0; i < 255; i++)
-    {
-        // rombank 0x01 offset 0x60E5 is a table with pointers for all tiles
-        src->seek(TILE_INDEX_TABLE + 2*i);
-        in >> pointer;
+                tilePos = 0x100 + tiles[tile].additionalTilesAt + j*tiles[tile].w + k - 1;
 
-        tiles[i].setSpecific = false;
-        tiles[i].type = 0;
-        tiles[i].projectileTileCount = 0;
-        tilesCount = 0;
+                if (getTile(cell) == tilePos)
+                    anchors[cell] = i;
+            }
+    }
 
-        // the pointer points to some meta data for every "tile"
-        // like tiles count and size of "super tiles"
+    // parts without their tile can only be erased on their own
+    for (int i = 0; i < cellCount; i++)
+        if ((anchors.at(i) == -1) && (getTile(i) > 0xFF))
+            anchors[i] = i;
+}
 
-        if (isSprite[i] && (i != 0x54))
-        {
-            // at last try pointer+3 for sprite tiles like DK and Mario
-            // the game code checks these tiles earlier but my code
-            // corrupts some tiles like 0x41 the plant in level 14
-            src->seek(pointer+3);
-            in >> tilesCount;
-            tiles[i].type = 3;
-        }
+int QDKEdit::anchorAt(int offset) const
+{
+    if ((offset < 0) || (offset >= anchors.size()))
+        return -1;
 
-        if (tilesCount == 0)
-        {
-            // first try pointer+4 for count
-            src->seek(pointer+4);
-            in >> tilesCount;
-            tiles[i].type = 4;
-        }
+    return anchors.at(offset);
+}
 
-        if (tilesCount == 0)
-        {
-            // next try pointer+5 for count
-            src->seek(pointer+5);
-            in >> tilesCount;
-            tiles[i].type = 5;
-        }
-        if (tilesCount == 0)
+void QDKEdit::eraseTile(int anchor)
+{
+    int width = levelDimension.width();
+    QSize footprint = tileFootprint(getTile(anchor));
+    int cell;
+
+    for (int j = 0; j < footprint.height(); j++)
+        for (int k = 0; k < footprint.width(); k++)
         {
-            // the tiles count includes "animations"
-            src->seek(pointer+2);
-            in >> tilesCount;
-            tiles[i].type = 2;
-
-            // check for projectile sprites
-            // sum values from pointer+3 and pointer+13
-            if (tilesCount != 0)
-            {
-                in >> byte;
-                if (byte)
-                {
-                    tiles[i].projectileTileCount = byte;
-                    src->seek(pointer+13);
-                    in >> byte;
-                    tiles[i].projectileTileCount += byte;
-                }
-            }
+            cell = anchor + k + j*width;
+            if ((anchor % width + k >= width) || (anchorAt(cell) != anchor))
+                continue;
 
-            // another exception...
-            if ((i == 0x9A) || (i == 0x8A) || (i == 0x9D) || (i == 0x9E) || (i == 0x54) || (i == 0x43) || (i == 0x79) || (i == 0xAF) || (i == 0x53) || (i == 0x65))
-            {
-                src->seek(pointer+0xD);
-                in >> byte;
-                if (byte >= tilesCount)
-                    tilesCount = byte;
-                //else
-                //    tilesCount -= byte;
-                // this results in wrong tilesCount for umbrella etc.
-                // but is need for compression check; fix see below
-            }
+            QTileEdit::setTile(cell, emptyTile);
+            anchors[cell] = -1;
         }
+}
 
-        if (tilesCount == 0)
-        {
-            // check again...
-            src->seek(pointer+3);
-            in >> tilesCount;
-            tiles[i].type = 3;
-        }
+void QDKEdit::setTile(int offset, int tileNumber)
+{
+    // tiles spanning several cells are only erased as a whole
+    int anchor = anchorAt(offset);
+    if ((anchor != -1) && ((anchor != offset) || (tileFootprint(getTile(anchor)) != QSize(1, 1))))
+        eraseTile(anchor);
 
-        // which tiles are compressed and which are not? if tilesCount >= 4 ???
-        tiles[i].compressed = (tilesCount >= 4);
+    QTileEdit::setTile(offset, tileNumber);
 
-        // exception for these tiles (see above)
-        if ((i == 0x9A) || (i == 0x8A) || (i == 0x9D) || (i == 0x9E) || (i == 0x54) || (i == 0x43) || (i == 0x79) || (i == 0xAF) || (i == 0x53) || (i == 0x65))
-            tiles[i].compressed = ((tilesCount - byte) >= 4);
+    if ((offset >= 0) && (offset < anchors.size()))
+        anchors[offset] = (tileNumber == emptyTile) ? -1 : offset;
+}
 
-        // get data needed for super tiles
-        //tiles[i].count = tilesCount;
-        src->seek(pointer+8);
-        in >> tiles[i].h;
-        in >> tiles[i].w;
-        tiles[i].count = tiles[i].h * tiles[i].w; // just get enough tiles to display the full super tile - no animations
-        tiles[i].fullCount = tilesCount;
+bool QDKEdit::moveTile(int anchor, int target)
+{
+    if ((anchor == target) || (anchorAt(anchor) != anchor))
+        return false;
 
-        if (tiles[i].count == 0)
-            continue;
+    int width = levelDimension.width();
+    int tile = getTile(anchor);
+    QSize footprint = tileFootprint(tile);
+    int x = target % width;
+    int y = target / width;
 
-        if (tiles[i].count > 1)
-        {
-            tiles[i].additionalTilesAt = addOffset;
-            addOffset += (tiles[i].count - 1);
-        }
+    if ((target < 0) || (x + footprint.width() > width) || (y + footprint.height() > levelDimension.height()))
+        return false;
 
-        if (i == 0x8A)
+    // other tiles are never overwritten by a move
+    for (int j = 0; j < footprint.height(); j++)
+        for (int k = 0; k < footprint.width(); k++)
         {
-            tiles[i].h = 4;
+            int owner = anchorAt(target + k + j*width);
+            if ((owner != -1) && (owner != anchor))
+                return false;
         }
 
-        if (i == 0x8E)
-        {
-            tiles[i].h = 2;
-            tiles[i].w = 2;
-        }
+    eraseTile(anchor);
+    setTile(target, tile);
+    expandTile(x, y, tile);
 
-        src->seek(pointer+6);
-        in >> pointer;
-        // and another pointer which either points to a rombank | pointer table
-        // or directly to the (compressed) tile data
+    dataIsChanged = true;
+    emit dataChanged(QTileChange(CHANGE_CELLS, QRect(QPoint(x, y), footprint) | QRect(QPoint(anchor % width, anchor / width), footprint)));
+    update();
 
-        // why should everything be nicely order in a rom bank | pointer table ?
-        // that would be too easy -- maybe it is <= instead of <
-        if (pointer < 0x7E00)
-        {
-            if (i < 0x80)
-                offset = 0xD*0x4000 + pointer;
-            else if (i < 0xAF)
-                offset = 0xC*0x4000 + pointer;
-            else
-                offset = 0x1B*0x4000 + pointer;
+    return true;
+}
 
-            tiles[i].romOffset = offset;
+QRect QDKEdit::hoverRect(int x, int y)
+{
+    int width = levelDimension.width();
+    int anchor = anchorAt(y * width + x);
+    if (anchor == -1)
+        return QTileEdit::hoverRect(x, y);
+
+    // the whole super tile is highlighted
+    QSize footprint = tileFootprint(getTile(anchor));
+    return QRect((anchor % width) * tileSize.width(), (anchor / width) * tileSize.height(), footprint.width() * tileSize.width() - 1, footprint.height() * tileSize.height() - 1);
+}
 
-            // quick hack to get the right offset for the mario sprite
-            if (i == 0x7F)
-            {
-                tiles[i].romOffset = 0x106F0;
-                tiles[i].fullCount = 0x50;
-            }
+void QDKEdit::copyTileToSet(QIODevice *src, quint32 offset, QImage *img, quint16 tileID, quint8 tileSetID = 0, bool compressed = false, quint8 tileCount = 1, quint16 superOffset = 0)
+{       
+    QByteArray data;
 
-            continue;
-        }
+    if (tiles[tileID].setSpecific)
+        src->seek(tileDataOffset(src, tileID, tileSetID));
+    else
+        src->seek(offset);
 
-        src->seek(0xd*0x4000 + pointer);
-        in >> bank;
-        in >> pointer;
+    if (compressed)
+    {
+        QDataStream decomp(src);
+        data = LZSSDecompress(&decomp, GB_TILE_BYTES*tileCount);
+    }
+    else
+        data = src->read(GB_TILE_BYTES*tileCount);
 
+    QGBTileDecoder::padTileData(&data, GB_TILE_BYTES*tileCount);
+    const uchar *tileData = (const uchar *)data.constData();
 
-        offset = (bank-1)*0x4000 + pointer;
+    for (int t = 0; t < tileCount; t++)
+    {
+        decodeTileToImage(tileData, img, (tileID % 16) * 8, (tileID / 16) * 8);
+        tileData += GB_TILE_BYTES;
 
-        tiles[i].setSpecific = true;
-        tiles[i].romOffset = offset;
+        tileID = 0x100 + superOffset + t;
     }
+}
 
-    tiles[0xFF].fullCount = 1;
-    tiles[0xFF].w = 1;
-    tiles[0xFF].h = 1;
-    tiles[0xFF].count = 1;
-    tiles[0xFF].compressed = false;
-
-    tiles[0x54].fullCount = 4;
+bool QDKEdit::createSprites()
+{
+    QDKTraceScope trace("createSprites");
 
-    // get supporting tiles from table @ ADDITIONAL_TILES_TABLE
-    quint8 count;
-    quint8 tile;
+    bool cached;
 
-    src->seek(ADDITIONAL_TILES_TABLE);
-    in >> count;
-    while (count != (quint8)0xFF)
+    // job 0 builds the sprites shared by all tilesets
+    // job N+1 the set specific sprites of tileset N
+    for (int set = -1; set < MAX_TILESETS; set++)
     {
-        in >> tile;
-        for (int i = 0; i < count; i++)
+        // a set is only taken from the cache if all of its sprites are in there
+        cached = true;
+        for (int id = 0; (id < 256) && cached; id++)
+            if (isSprite[id] && (tiles[id].setSpecific == (set >= 0)))
+                cached = assetCached(QDKAssetCache::spriteKey(id, set));
+
+        if (cached)
         {
-            in >> byte;
-            tiles[tile].needsTiles.append(byte);
+            for (int id = 0; id < 256; id++)
+                if (isSprite[id] && (tiles[id].setSpecific == (set >= 0)))
+                    spriteImg.insert(spriteKey(id, set), new QImage(assetCache.image(QDKAssetCache::spriteKey(id, set), fallbackColors)));
+
+            spritesReady[set+1] = true;
+            continue;
         }
-        in >> count;
+
+        spritesReady[set+1] = false;
+        spriteJobs[set+1] = QtConcurrent::run(this, &QDKEdit::buildSprites, set);
+        assetsBuilt = true;
     }
 
     return true;
 }
 
-
-
-bool QDKEdit::createSprites(QFile *src, QGBPalette palette)
+void QDKEdit::waitForSprites(int set)
 {
-    QDataStream *in;
-    quint16 tileX, tileY, pointer;
-    quint8 low, high, pixel, firstSet, secondSet;
-    QByteArray decompressed;
-
-    QDir dir;
-    if (!dir.exists("sprites"))
-        dir.mkdir("sprites");
+    if ((set < -1) || (set >= MAX_TILESETS) || spritesReady[set+1])
+        return;
 
-    QImage *sprite;
-    int setsToGo = 1;
+    QDKTraceScope trace("waitForSprites", set);
 
-    for (int id = 0; id < 256; id++)
+    QDKSpriteImages images = spriteJobs[set+1].result();
+    QDKSpriteImages::const_iterator i = images.constBegin();
+    while (i != images.constEnd())
     {
-        if (isSprite[id])
-        {
-            if (tiles[id].setSpecific)
-                setsToGo = MAX_TILESETS;
-            else
-                setsToGo = 1;
+        spriteImg.insert(i.key(), new QImage(i.value()));
+        ++i;
+    }
 
-            for (int set = 0; set < setsToGo; set++)
-            {
-                if (setsToGo == 1)
-                {
-                    if (QFile::exists(QString("sprites/sprite_%1.png").arg(id, 2, 16, QChar('0'))))
-                    {
-                        spriteImg.insert(QString("sprite_%1.png").arg(id, 2, 16, QChar('0')), new QImage(QString("sprites/sprite_%1.png").arg(id, 2, 16, QChar('0'))));
-                        continue;
-                    }
-                }
-                else
-                {
-                    if (QFile::exists(QString("sprites/sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(set, 2, 16, QChar('0'))))
-                    {
-                        spriteImg.insert(QString("sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(set, 2, 16, QChar('0')), new QImage(QString("sprites/sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(set, 2, 16, QChar('0'))));
-                        continue;
-                    }
-                }
+    spritesReady[set+1] = true;
+}
 
-                sprite = new QImage(8*tiles[id].w, 8*tiles[id].h, QImage::Format_Indexed8);
-                sprite->setColor(0, palette[0].rgb());
-                sprite->setColor(1, palette[1].rgb());
-                sprite->setColor(2, palette[2].rgb());
-                sprite->setColor(3, palette[3].rgb());
+QImage QDKEdit::spriteImage(int id)
+{
+    if ((id < 0) || (id > 255) || !isSprite[id])
+        return QImage();
 
-                if (tiles[id].setSpecific)
-                {
-                    QDataStream tmp(src);
+    // set specific sprites are shown with their tileset 0 variant
+    waitForSprites(tiles[id].setSpecific ? 0 : -1);
 
-                    // get the two sub tilesets offsets
-                    // rombank 0xC offset 0x4EEB is a table of two offsets for every tileset
-                    tmp.setByteOrder(QDataStream::LittleEndian);
-                    src->seek(SUBTILESET_TABLE + (set*2));
+    QImage *img = spriteImg.value(spriteKey(id, 0), NULL);
+    if (!img)
+        return QImage();
 
-                    tmp >> firstSet;
-                    tmp >> secondSet;
+    return *img;
+}
 
-                    // this is finally the last pointer before the actual tile data...
-                    // here are the "same" tiles from different tilesets grouped together
-                    if ((id < 0xCD) || (id == 0xFD))
-                        src->seek(tiles[id].romOffset + firstSet);
-                    else
-                        src->seek(tiles[id].romOffset + secondSet);
+QDKSpriteImages QDKEdit::buildSprites(int set)
+{
+    QDKTraceScope trace("buildSprites", set);
 
-                    tmp >> pointer;
+    quint16 dataSize;
+    QByteArray data;
+    const uchar *tileData;
 
-                    src->seek(tiles[id].romOffset + pointer);
-                }
-                else
-                    src->seek(tiles[id].romOffset);
+    QDKSpriteImages images;
+    QString key;
 
-                if (tiles[id].compressed)
-                {
-                    QDataStream decomp(src);
-                    quint16 decompSize;
-                    if (id == 0xC2)
-                        decompSize = 0x10*(tiles[id].count+2);
-                    else if (id == 0x8E)
-                        decompSize = 0x40;
-                    else
-                        decompSize = 0x10*tiles[id].count;
-                    decompressed = LZSSDecompress(&decomp, decompSize);
-                    in = new QDataStream(decompressed);
-                }
-                else
-                    in = new QDataStream(src);
+    // every job reads from its own buffer
+    QBuffer rom;
+    rom.setData(baseRomData);
+    rom.open(QIODevice::ReadOnly);
+    QIODevice *src = &rom;
 
-                in->setByteOrder(QDataStream::LittleEndian);
+    for (int id = 0; id < 256; id++)
+    {
+        if (!isSprite[id])
+            continue;
 
-                sprite->fill(3);
+        if (tiles[id].setSpecific != (set >= 0))
+            continue;
 
-                for (int i = 0; i < tiles[id].w; i++)
-                    for (int j = 0; j < tiles[id].h; j++)
-                    {
-                        tileY = j * 8;
-                        tileX = i * 8;
+        key = spriteKey(id, set);
 
-                        //skip empty tiles for specific sprites
-                        if (((id == 0xC2) && (i == 0) && (j == 0)) ||
-                            ((id == 0xC2) && (i == 0) && (j == 1)))
-                            for (int z = 0; z < 16; z++)
-                                (*in) >> low;
+        // only sprites whose rom data changed are rebuilt
+        if (assetCached(QDKAssetCache::spriteKey(id, set)))
+        {
+            images.insert(key, assetCache.image(QDKAssetCache::spriteKey(id, set), fallbackColors));
+            continue;
+        }
 
-                        for (int ii = 0; ii < 8; ii++)
-                        {
-                            (*in) >> low;
-                            (*in) >> high;
+        QImage sprite(8*tiles[id].w, 8*tiles[id].h, QImage::Format_Indexed8);
+        sprite.setColorTable(fallbackColors);
 
-                            for (int jj = 0; jj < 8; jj++)
-                            {
-                                pixel = low & 0x80;
-                                pixel >>= 1;
-                                pixel |= high & 0x80;
-                                pixel >>= 6;
+        src->seek(tileDataOffset(src, id, set));
 
-                                low <<= 1;
-                                high <<= 1;
+        // bytes needed to fill the whole sprite
+        dataSize = GB_TILE_BYTES*(tiles[id].w*tiles[id].h);
+        if (id == 0xC2)
+            dataSize += 2*GB_TILE_BYTES;
 
-                                sprite->setPixel(tileX+jj, tileY+ii, pixel);
-                            }
-                        }
+        if (tiles[id].compressed)
+        {
+            QDataStream decomp(src);
+            quint16 decompSize;
+            if (id == 0xC2)
+                decompSize = 0x10*(tiles[id].count+2);
+            else if (id == 0x8E)
+                decompSize = 0x40;
+            else
+                decompSize = 0x10*tiles[id].count;
+            data = LZSSDecompress(&decomp, decompSize);
+        }
+        else
+            data = src->read(dataSize);
 
-                    }
+        QGBTileDecoder::padTileData(&data, dataSize);
+        tileData = (const uchar *)data.constData();
 
-                sortSprite(sprite, id);
+        sprite.fill(3);
 
-                if (tiles[id].setSpecific)
-                    sprite->save(QString("sprites/sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(set, 2, 16, QChar('0')));
-                else
-                    sprite->save(QString("sprites/sprite_%1.png").arg(id, 2, 16, QChar('0')));
+        for (int i = 0; i < tiles[id].w; i++)
+            for (int j = 0; j < tiles[id].h; j++)
+            {
+                //skip empty tiles for specific sprites
+                if (((id == 0xC2) && (i == 0) && (j == 0)) ||
+                    ((id == 0xC2) && (i == 0) && (j == 1)))
+                    tileData += GB_TILE_BYTES;
 
-                /*QPixmap *tmp;
-                tmp = new QPixmap();
-                tmp->convertFromImage(*sprite);
-                delete sprite;*/
+                decodeTileToImage(tileData, &sprite, i * 8, j * 8);
+                tileData += GB_TILE_BYTES;
+            }
 
-                if (tiles[id].setSpecific)
-                    spriteImg.insert(QString("sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(set, 2, 16, QChar('0')), sprite);
-                else
-                    spriteImg.insert(QString("sprite_%1.png").arg(id, 2, 16, QChar('0')), sprite);
+        sortSprite(&sprite, id);
 
-                delete in;
-            }
-        }
+        images.insert(key, sprite);
     }
 
-    return true;
+    return images;
 }
 
 void QDKEdit::sortSprite(QImage *sprite, int id)
@@ -1614,23 +964,12 @@ void QDKEdit::fillTile(QImage *img, int x, int y, int index)
             img->setPixel(x*8 + i, y*8 + j, index);
 }
 
-bool QDKEdit::createTileSets(QFile *src, QGBPalette palette)
+bool QDKEdit::createTileSets()
 {
-    QDataStream in(src);
-    in.setByteOrder(QDataStream::LittleEndian);
+    QDKTraceScope trace("createTileSets");
 
     quint8 tmp;
 
-    QImage fullSet(128, 352, QImage::Format_Indexed8);
-    fullSet.setColor(0, palette[0].rgb());
-    fullSet.setColor(1, palette[1].rgb());
-    fullSet.setColor(2, palette[2].rgb());
-    fullSet.setColor(3, palette[3].rgb());
-
-    QDir dir;
-    if (!dir.exists("tiles"))
-        dir.mkdir("tiles");
-
     for (int id = 0; id < MAX_TILESETS; id++)
     {
         tmp = id & 0x0F;
@@ -1639,237 +978,266 @@ bool QDKEdit::createTileSets(QFile *src, QGBPalette palette)
         else
             tilesetBGP[id] = 0x9C;
 
-        if (QFile::exists(QString("tiles/tileset_%1.png").arg(id, 2, 16, QChar('0'))))
-        {
-            tilesets[id].load(QString("tiles/tileset_%1.png").arg(id, 2, 16, QChar('0')));
-            continue;
-        }
+        // tilesets are only materialized when they are needed
+        tilesetRequested[id] = false;
+        tilesetReady[id] = false;
+    }
 
-        fullSet.fill(0);
+    return true;
+}
 
-        for (int i = 0; i < 255; i++) // since 0xFF is the empty tile we just skip it altogether
-            copyTileToSet(src, tiles[i].romOffset, &fullSet, i, id, tiles[i].compressed, tiles[i].count, tiles[i].additionalTilesAt);
+void QDKEdit::requestTileset(int id)
+{
+    if ((id < 0) || (id >= MAX_TILESETS) || tilesetRequested[id])
+        return;
 
-        tilesets[id] = fullSet;
-        fullSet.save(QString("tiles/tileset_%1.png").arg(id, 2, 16, QChar('0')));
+    tilesetRequested[id] = true;
+
+    if (assetCached(QDKAssetCache::tilesetKey(id)))
+    {
+        tilesets[id] = assetCache.image(QDKAssetCache::tilesetKey(id), fallbackColors);
+        tilesetReady[id] = true;
+        return;
     }
 
-    return true;
+    tilesetJobs[id] = QtConcurrent::run(this, &QDKEdit::buildTileset, id);
+    assetsBuilt = true;
 }
 
-QByteArray QDKEdit::LZSSDecompress(QDataStream *in, quint16 decompressedSize)
+void QDKEdit::waitForTileset(int id)
 {
-    in->setByteOrder(QDataStream::LittleEndian);
+    if ((id < 0) || (id >= MAX_TILESETS) || tilesetReady[id])
+        return;
 
-    QByteArray decompressed;
+    requestTileset(id);
+    if (tilesetReady[id])
+        return;
 
-    quint8 byte, flags, len, byte2;
-    quint16 start;
-    quint32 offset;
+    QDKTraceScope trace("waitForTileset", id);
 
-    while (decompressed.size() < decompressedSize)
-    {
-        (*in) >> flags;
+    tilesets[id] = tilesetJobs[id].result();
+    tilesetReady[id] = true;
+}
 
-        for (int i = 0; i < 8; i++)
-        {
-            if (flags & 0x1) // raw data
-            {
-                (*in) >> byte;
-                decompressed.append(byte);
-            }
-            else // copy data
-            {
-                (*in) >> byte;
-                (*in) >> len;
+void QDKEdit::prefetchTilesets(int level)
+{
+    // start on the tilesets of the neighbouring levels
+    // so switching to them doesn't have to wait
+    for (int i = level - TILESET_PREFETCH_RANGE; i <= level + TILESET_PREFETCH_RANGE; i++)
+        if ((i >= 0) && (i <= LAST_LEVEL) && (i != level))
+            requestTileset(levels[i].tileset);
+}
 
-                //start is actually 12bit and length only 4bit
-                byte2 = len;
-                start = (quint16)byte + (0x100 * ((quint16)len / 0x10));
-                len = len % 0x10;
+QImage QDKEdit::buildBaseTileset(QIODevice *src)
+{
+    // tiles which are the same in every tileset are decoded only once
+    // the first job needing them builds them while the others wait
+    QMutexLocker locker(&baseTilesetMutex);
 
-                len += 3;
-                if (start == 0)
-                {
-                    qWarning() << QString("LZSSDecompress: something went wrong; start = 0");
-                    //qDebug() << decompressedSize << decompressed.size() << byte << byte2 << len;
-                    return decompressed;
-                }
-                offset = decompressed.size() - start;
-                //qDebug() << "start " << start << " length " << len;
+    if (baseTileset.isNull())
+    {
+        QDKTraceScope trace("buildBaseTileset");
 
-                for (int j = 0; j < len; j++)
-                    decompressed.append((quint8)decompressed.at(offset+j));
-            }
+        QImage baseSet(128, 352, QImage::Format_Indexed8);
+        baseSet.setColorTable(fallbackColors);
+        baseSet.fill(0);
 
-            flags >>= 1;
+        for (int i = 0; i < 255; i++) // since 0xFF is the empty tile we just skip it altogether
+            if (!tiles[i].setSpecific)
+                copyTileToSet(src, tiles[i].romOffset, &baseSet, i, 0, tiles[i].compressed, tiles[i].count, tiles[i].additionalTilesAt);
 
-            if (decompressed.size() >= decompressedSize)
-                break;
-        }
+        baseTileset = baseSet;
     }
 
-    return decompressed;
+    return baseTileset;
 }
 
-QByteArray QDKEdit::LZSSCompress(QByteArray *src)
+QImage QDKEdit::buildTileset(int id)
 {
-    QByteArray compressed;
-    quint8 flagByte, flagBit, byte;
-    qint32 srcPos, flagBytePos, matchLength, matchRelativePos, currentMatchLength, j, matchEnd;
+    QDKTraceScope trace("buildTileset", id);
+
+    // every job reads from its own buffer
+    QBuffer rom;
+    rom.setData(baseRomData);
+    rom.open(QIODevice::ReadOnly);
 
-    flagByte = 0x1;
-    flagBytePos = 0;
-    flagBit = 0x2;
-    srcPos = 0;
+    // only the set specific tiles are taken from the sub tilesets
+    QImage fullSet = buildBaseTileset(&rom).copy();
 
-    // add first flag byte (place holder) and add first raw data byte
-    compressed.append(flagByte);
-    compressed.append((quint8)src->at(srcPos++));
+    for (int i = 0; i < 255; i++)
+        if (tiles[i].setSpecific)
+            copyTileToSet(&rom, tiles[i].romOffset, &fullSet, i, id, tiles[i].compressed, tiles[i].count, tiles[i].additionalTilesAt);
 
-    while (srcPos < src->size())
-    {
-        // find match in previous data
+    return fullSet;
+}
 
-        // start max 4096 bytes back from current pos
-        if (srcPos <= 4096)
-            matchEnd = 0;
-        else
-            matchEnd = srcPos - 4096;
+QString QDKEdit::spriteKey(int id, int tileset)
+{
+    if (tiles[id].setSpecific)
+        return QString("sprite_%1_set_%2").arg(id, 2, 16, QChar('0')).arg(tileset, 2, 16, QChar('0'));
+    else
+        return QString("sprite_%1").arg(id, 2, 16, QChar('0'));
+}
 
-        matchLength = 0;
+QPixmap *QDKEdit::spritePixmap(int id)
+{
+    if (!currentRender)
+        return NULL;
 
-        // try from current position
-        //for (int i = matchEnd; i < srcPos; i++)
-        for (int i = srcPos-1; i >= matchEnd; i--)
-        {
-            // start compare for every i
-            j = 0;
-            while ((*src)[i+j] == (*src)[srcPos+j])
-            {
-                j++;
-                // make sure to stay inside 4 bits (+3) and inside byte array
-                if ((j >= 18) || (i+j >= src->size()) || (srcPos+j >= src->size()))
-                    break;
-            }
+    return currentRender->spritePix[transparentSprites].value(spriteKey(id, currentTileset), NULL);
+}
 
-            // remember best match
-            currentMatchLength = j;
-            if (matchLength < currentMatchLength)
-            {
-                matchLength = currentMatchLength;
-                matchRelativePos = (srcPos - i);
-            }
+QDKRenderedTileset *QDKEdit::renderTileset(int tileset, quint16 palIndex, quint8 bgp)
+{
+    QDKTraceScope trace("renderTileset", tileset);
 
-            // no point in looking further if this is max length
-            if (currentMatchLength == 18)
-                break;
-        }
+    QDKRenderedTileset *render = new QDKRenderedTileset();
+    render->tileset = tileset;
+    render->palIndex = palIndex;
 
-        // check if it is long enough
-        if (matchLength < 3) // too short
-        {
-            flagByte |= flagBit; // raw data - not compressed
-            compressed.append((quint8)src->at(srcPos++)); // add raw data byte
-        }
-        else
-        {
-            // nothing to do with the flag byte
+    waitForTileset(tileset);
+    waitForSprites(-1);
+    waitForSprites(tileset);
 
-            // move srcPos after length
-            srcPos += matchLength;
+    tilesets[tileset].setColorTable(paletteTable(palIndex, bgp));
+    render->tileSet.convertFromImage(tilesets[tileset]);
 
-            // adjust length
-            matchLength -= 3;
+    renderSprites(render, transparentSprites);
 
-            // add relative start and length to copy
-            if (matchRelativePos > 255)
-            {
-                byte = matchRelativePos % 0x100;
-                compressed.append(byte);
-                byte = matchLength + (0x10 * (matchRelativePos / 0x100));
-                compressed.append(byte);
-            }
-            else
-            {
-                compressed.append((quint8)matchRelativePos);
-                compressed.append((quint8)matchLength);
-            }
-        }
+    return render;
+}
 
-        if (flagBit == 0x80) // flag byte fully populated
-        {
-            compressed[flagBytePos] = flagByte; // write correct flag byte back to original position
+void QDKEdit::renderSprites(QDKRenderedTileset *render, bool transparent)
+{
+    // some sprites should use 0x9C as OBP
+    // hammer for example
+    // but we ignore that (at least for now)
+    QVector<QRgb> obp = paletteTable(render->palIndex, 0x1E);
 
-            // reset flag byte and counter bit
-            flagByte = 0;
-            flagBit = 0x1;
+    // colour index 0 is transparent for sprites
+    if (transparent)
+        obp[0] = qRgba(0, 0, 0, 0);
 
-            // save new flag byte position
-            flagBytePos = compressed.size();
+    // only the sprites which can show up with this tileset
+    QImage *img;
+    QString key;
+    for (int id = 0; id < 256; id++)
+    {
+        if (!isSprite[id])
+            continue;
 
-            if (srcPos < src->size()) // make sure there is more data
-                compressed.append((quint8)0x1D); // place holder for flag byte
-        }
-        else // shift flag bit
-            flagBit <<= 1;
-    }
+        key = spriteKey(id, render->tileset);
+        img = spriteImg.value(key, NULL);
+        if (!img)
+            continue;
 
-    // write back last incomplete flag byte
-    if (flagBit != 1)
-        compressed[flagBytePos] = flagByte;
+        img->setColorTable(obp);
 
-    return compressed;
+        if (transparent)
+            render->spritePix[1].insert(key, new QPixmap(QPixmap::fromImage(img->convertToFormat(QImage::Format_ARGB32_Premultiplied))));
+        else
+            render->spritePix[0].insert(key, new QPixmap(QPixmap::fromImage(*img)));
+    }
 }
 
 void QDKEdit::updateTileset()
 {
-    // adjust color table
-    quint8 mask;
     quint8 bgp = tilesetBGP[currentTileset];
-    for (int i = 0; i < 4; i++)
+    quint32 key = ((quint32)currentTileset << 24) | ((quint32)bgp << 16) | currentPalIndex;
+
+    if (!currentRender || (key != currentRenderKey))
     {
-        mask = bgp & 0x03;
-        bgp >>= 2;
-        tilesets[currentTileset].setColor(i, sgbPal[currentPalIndex][mask].rgb());
-    }
+        // the active entry is kept out of the cache so its pixmaps
+        // can't get evicted while sprites still point to them
+        if (currentRender)
+        {
+            renderCacheBytes.insert(currentRenderKey, renderedBytes(currentRender));
+            renderCache.insert(currentRenderKey, currentRender);
+        }
 
-    tileSet.convertFromImage(tilesets[currentTileset]);
+        currentRender = renderCache.take(key);
+        currentRenderKey = key;
 
-    if (selector)
-        selector->changeTilePixmap(tileSet);
+        if (!currentRender)
+            currentRender = renderTileset(currentTileset, currentPalIndex, bgp);
 
-    qDeleteAll(spritePix);
-    QPixmap *tmp;
-    QImage *img;
-    QMap<QString, QImage *>::const_iterator i = spriteImg.constBegin();
-    while (i != spriteImg.constEnd())
-    {
-        img = i.value();
-        // some sprites should use 0x9C as OBP
-        // hammer for example
-        // but we ignore that (at least for now)
-        bgp = 0x1E;
-        for (int j = 0; j < 4; j++)
-        {
-            mask = bgp & 0x03;
-            bgp >>= 2;
-            img->setColor(j, sgbPal[currentPalIndex][mask].rgb());
-        }
+        tileSet = currentRender->tileSet;
 
-        tmp = new QPixmap();
-        tmp->convertFromImage(*img);
-        if (transparentSprites)
-            tmp->setMask(tmp->createMaskFromColor(img->color(0)));
-        spritePix.insert(i.key(), tmp);
-        ++i;
+        if (selector)
+            selector->changeTilePixmap(tileSet, &currentRender->selectorImage);
     }
 
+    // the other sprite variant is only built on first use
+    if (currentRender->spritePix[transparentSprites].isEmpty())
+        renderSprites(currentRender, transparentSprites);
+
     for (int i = 0; i < sprites.size(); i++)
-        if (tiles[sprites[i].id].setSpecific)
-            sprites[i].sprite = spritePix[QString("sprite_%1_set_%2.png").arg(sprites.at(i).id, 2, 16, QChar('0')).arg(currentTileset, 2, 16, QChar('0'))];
+        sprites[i].sprite = spritePixmap(sprites.at(i).id);
+}
+
+qint64 QDKEdit::imageBytes(const QImage &img) const
+{
+    // pixels from the asset cache are counted with the mapped file
+    if (img.isNull() || assetCache.isMapped(img.constBits()))
+        return 0;
+
+    return img.byteCount();
+}
+
+qint64 QDKEdit::renderedBytes(const QDKRenderedTileset *render) const
+{
+    qint64 bytes = (qint64)render->tileSet.width() * render->tileSet.height() * render->tileSet.depth() / 8;
+    bytes += imageBytes(render->selectorImage);
+
+    QMap<QString, QPixmap *>::const_iterator i;
+    for (int t = 0; t < 2; t++)
+        for (i = render->spritePix[t].constBegin(); i != render->spritePix[t].constEnd(); ++i)
+            bytes += (qint64)i.value()->width() * i.value()->height() * i.value()->depth() / 8;
+
+    return bytes;
+}
+
+void QDKEdit::memoryUsage(QDKMemoryReport *report)
+{
+    levelMemoryUsage(report);
+
+    qint64 bytes = lvlData.capacity() + sprites.size() * sizeof(QSprite) + currentSwitches.size() * sizeof(QDKSwitch);
+    for (int i = 0; i < currentSwitches.size(); i++)
+        bytes += currentSwitches.at(i).connectedTo.size() * sizeof(QDKSwitchObject);
+    report->categories["current level"] = bytes;
+
+    report->categories["undo"] = undoMemory();
+    report->categories["undo (other levels, compressed)"] = historyBytes;
+    report->categories["usage index"] = usage.bytes();
+
+    bytes = imageBytes(baseTileset);
+    for (int i = 0; i < MAX_TILESETS; i++)
+        bytes += imageBytes(tilesets[i]);
+    report->categories["tilesets"] = bytes;
+
+    bytes = 0;
+    QMap<QString, QImage *>::const_iterator img;
+    for (img = spriteImg.constBegin(); img != spriteImg.constEnd(); ++img)
+        bytes += imageBytes(*img.value());
+    report->categories["sprite images"] = bytes;
+
+    // drop entries the cache has evicted since
+    bytes = currentRender ? renderedBytes(currentRender) : 0;
+    QHash<quint32, qint64>::iterator render = renderCacheBytes.begin();
+    while (render != renderCacheBytes.end())
+    {
+        if (!renderCache.contains(render.key()))
+            render = renderCacheBytes.erase(render);
         else
-            sprites[i].sprite = spritePix[QString("sprite_%1.png").arg(sprites.at(i).id, 2, 16, QChar('0'))];
+        {
+            bytes += render.value();
+            ++render;
+        }
+    }
+    report->categories["rendered tilesets"] = bytes;
+
+    report->categories["rom data"] = baseRomData.capacity();
+    report->categories["asset cache (mapped)"] = assetCache.mappedSize();
 }
 
 void QDKEdit::changeMusic(int music)
@@ -1878,8 +1246,10 @@ void QDKEdit::changeMusic(int music)
     {
         currentMusic = music;
         dataIsChanged = true;
+        journalProperties(currentLevel, currentSize, currentMusic, currentTileset, currentTime, currentPalIndex);
 
         emit musicChanged(music);
+        emit dataChanged(QTileChange(CHANGE_PROPERTIES));
     }
 }
 
@@ -1889,10 +1259,12 @@ void QDKEdit::changePalette(int palette)
     {
         currentPalIndex = palette;
         dataIsChanged = true;
+        journalProperties(currentLevel, currentSize, currentMusic, currentTileset, currentTime, currentPalIndex);
 
         updateTileset();
         update();
         emit paletteChanged(palette);
+        emit dataChanged(QTileChange(CHANGE_PROPERTIES));
     }
 }
 
@@ -1902,6 +1274,7 @@ void QDKEdit::changeSize(int size)
     {
         currentSize = size;
         dataIsChanged = true;
+        journalProperties(currentLevel, currentSize, currentMusic, currentTileset, currentTime, currentPalIndex);
         int oldLength = lvlDataLength;
 
         if (size == 0x00)
@@ -1922,9 +1295,11 @@ void QDKEdit::changeSize(int size)
             lvlData[i] = (quint8)emptyTile;
             lvlData[i+1] = 0x00;
         }
+        rebuildAnchors();
 
         update();
         emit sizeChanged(size);
+        emit dataChanged(QTileChange(CHANGE_CELLS | CHANGE_PROPERTIES));
     }
 }
 
@@ -1934,10 +1309,12 @@ void QDKEdit::changeTileset(int tileset)
     {
         currentTileset = tileset;
         dataIsChanged = true;
+        journalProperties(currentLevel, currentSize, currentMusic, currentTileset, currentTime, currentPalIndex);
 
         updateTileset();
         update();
         emit tilesetChanged(tileset);
+        emit dataChanged(QTileChange(CHANGE_PROPERTIES));
     }
 }
 
@@ -1947,8 +1324,10 @@ void QDKEdit::changeTime(int time)
     {
         currentTime = time;
         dataIsChanged = true;
+        journalProperties(currentLevel, currentSize, currentMusic, currentTileset, currentTime, currentPalIndex);
 
         emit changeTime(time);
+        emit dataChanged(QTileChange(CHANGE_PROPERTIES));
     }
 }
 
@@ -1982,39 +1361,15 @@ void QDKEdit::addSprite(int id)
     if (id == 0x54)
         sprite.drawOffset.setX(-0.5f);
 
-    if (tiles[id].setSpecific)
-       sprite.sprite = spritePix[QString("sprite_%1_set_%2.png").arg(id, 2, 16, QChar('0')).arg(currentTileset, 2, 16, QChar('0'))];
-   else
-       sprite.sprite = spritePix[QString("sprite_%1.png").arg(id, 2, 16, QChar('0'))];
+    sprite.sprite = spritePixmap(id);
 
     sprites.append(sprite);
     emit spriteAdded(spriteNumToString(id), id);
     dataIsChanged = true;
-    emit dataChanged();
+    emit dataChanged(QTileChange(CHANGE_SPRITES, QRect(), sprites.size()-1));
     update();
 }
 
-quint8 QDKEdit::getSpriteDefaultFlag(int id)
-{
-    switch (id)
-    {
-        case 0x80: case 0x98: return 0x03; // walking friend+enemy
-        case 0x70: case 0x72: return 0x05; // elevator up/down
-        case 0x54: case 0x84: return 0x00;
-        case 0x7F:            return 0x00; // Mario
-        case 0xB8:            return 0xFF; // key/hole 0/1 ? WTF?!
-        //different DKs
-        /*set in game: 6E 00
-                       9A 01 00
-                       CC 01
-                       B8 00 01 */
-        case 0x6E: return 0xFF; // probably 0x00                               // Lvl0-1, 9-5 barrels
-        case 0x9A: return 0xFF; // even more guessed 0x00                      // Lvl1-4, 5-4, 7-8, 9-1 avalanche
-        case 0xCC: return 0xFF; // this one at least is never set explicitly   // Lvl1-8, 2-12, 3-8, 6-8, 7-12 pick-up barrels
-        default: return 0x00;
-    }
-}
-
 void QDKEdit::updateSprite(int num)
 {
     if (num >= sprites.size())
@@ -2357,10 +1712,7 @@ void QDKEdit::saveLevel()
     if ((currentLevel != -1) && (dataIsChanged))
     {
         levels[currentLevel].fullDataUpToDate = false;
-        levels[currentLevel].displayTilemap.clear();
-        levels[currentLevel].displayTilemap.append(lvlData);
-        updateRawTilemap(currentLevel);
-        expandRawTilemap(currentLevel);
+        levels[currentLevel].tilemap = lvlData; // shared until either side is edited
         levels[currentLevel].sprites.clear();
         for (int i = 0; i < sprites.size(); i++)
         {
@@ -2373,16 +1725,7 @@ void QDKEdit::saveLevel()
         for (int i = 0; i < currentSwitches.size(); i++)
         {
             levels[currentLevel].switches.append(currentSwitches[i]);
-            levels[currentLevel].switches[i].levelPos = levels[currentLevel].switches[i].y * levelDimension.width() + levels[currentLevel].switches[i].x;
-            levels[currentLevel].switches[i].ramPos = levels[currentLevel].switches[i].levelPos + 0xD44D;
-            for (int j = 0; j < levels[currentLevel].switches[i].connectedTo.size(); j++)
-            {
-                levels[currentLevel].switches[i].connectedTo[j].levelPos = levels[currentLevel].switches[i].connectedTo[j].y * levelDimension.width() + levels[currentLevel].switches[i].connectedTo[j].x;
-                if (levels[currentLevel].switches[i].connectedTo[j].isSprite)
-                    levels[currentLevel].switches[i].connectedTo[j].ramPos = levels[currentLevel].switches[i].connectedTo[j].levelPos + 0xDA75;
-                else
-                    levels[currentLevel].switches[i].connectedTo[j].ramPos = levels[currentLevel].switches[i].connectedTo[j].levelPos + 0xD44D;
-            }
+            updateSwitchPositions(&levels[currentLevel].switches[i]);
         }
 
         levels[currentLevel].size = currentSize;
@@ -2390,6 +1733,11 @@ void QDKEdit::saveLevel()
         levels[currentLevel].tileset = currentTileset;
         levels[currentLevel].music = currentMusic;
         levels[currentLevel].paletteIndex = currentPalIndex;
+
+        usage.updateLevel(this, currentLevel);
+        markUndoSaved();
+
+        emit dataChanged(QTileChange(CHANGE_LEVEL));
     }
 
     dataIsChanged = false;
@@ -2397,17 +1745,28 @@ void QDKEdit::saveLevel()
 
 void QDKEdit::changeLevel(int id)
 {
+    QDKTraceScope trace("changeLevel", id);
+
     if (!romLoaded)
         return;
 
+    if (currentLevel != -1)
+    {
+        // unsaved property changes get discarded as well
+        QDKLevel *lvl = &levels[currentLevel];
+        if ((currentSize != lvl->size) || (currentMusic != lvl->music) || (currentTileset != lvl->tileset)
+                || (currentTime != lvl->time) || (currentPalIndex != lvl->paletteIndex))
+            journalProperties(currentLevel, lvl->size, lvl->music, lvl->tileset, lvl->time, lvl->paletteIndex);
+
+        stashLevelHistory(currentLevel);
+    }
+
     dataIsChanged = false;
-    clearUndoData();
     currentLevel = id;
     swObjToMove = -1;
     spriteToMove = -1;
 
-    lvlData.clear();
-    lvlData.append(levels[currentLevel].displayTilemap);
+    lvlData = levels[currentLevel].tilemap;
 
     currentSize = levels[currentLevel].size;
     currentTime = levels[currentLevel].time;
@@ -2426,8 +1785,10 @@ void QDKEdit::changeLevel(int id)
         setLevelDimension(32, 18);
     else
         setLevelDimension(32, 28);
+    rebuildAnchors();
 
     updateTileset();
+    prefetchTilesets(currentLevel);
 
     for (int i = sprites.size()-1; i >= 0; i--)
         emit spriteRemoved(i);
@@ -2445,10 +1806,7 @@ void QDKEdit::changeLevel(int id)
     for (int i = 0; i < levels[currentLevel].sprites.size(); i++)
     {
         sprites.append(levels[currentLevel].sprites.at(i));
-        if (tiles[sprites[i].id].setSpecific)
-           sprites[i].sprite = spritePix[QString("sprite_%1_set_%2.png").arg(sprites.at(i).id, 2, 16, QChar('0')).arg(currentTileset, 2, 16, QChar('0'))];
-        else
-           sprites[i].sprite = spritePix[QString("sprite_%1.png").arg(sprites.at(i).id, 2, 16, QChar('0'))];
+        sprites[i].sprite = spritePixmap(sprites.at(i).id);
         emit spriteAdded(spriteNumToString(sprites[i].id), sprites[i].id);
     }
 
@@ -2458,13 +1816,16 @@ void QDKEdit::changeLevel(int id)
         emit switchAdded(&levels[currentLevel].switches[i]);
     }
 
+    // the new level is the base of its undo log
+    restoreLevelHistory(currentLevel);
+
+    // recounted on the notification
     vramSprites = 0;
     vramTiles = 0;
-    calcVRAMusage();
 
     update();
 
-    emit dataChanged();
+    emit dataChanged(QTileChange(CHANGE_ALL));
     emit paletteChanged(levels[currentLevel].paletteIndex);
     emit tilesetChanged(levels[currentLevel].tileset);
     emit timeChanged(levels[currentLevel].time);
@@ -2623,6 +1984,23 @@ void QDKEdit::toggleSwitchMode(int enabled)
 
 void QDKEdit::mouseMoveEvent(QMouseEvent *e)
 {
+    if (!spriteMode && (e->buttons() == Qt::MiddleButton))
+    {
+        if ((tileToMove == -1) || (e->x()+1 > scaledSize.width()) || (e->x() < 0) || (e->y()+1 > scaledSize.height()) || (e->y() < 0))
+            return;
+
+        QPoint cell = cellAt(e->pos()) - moveGrab;
+        int target = cell.y() * levelDimension.width() + cell.x();
+
+        // stays in place while the target is taken by another tile
+        if ((cell.x() >= 0) && (cell.y() >= 0) && moveTile(tileToMove, target))
+        {
+            tileToMove = target;
+            mouseOverTile = hoverRect(cell.x(), cell.y());
+        }
+        return;
+    }
+
     if (!switchMode)
     {
         QTileEdit::mouseMoveEvent(e);
@@ -2832,7 +2210,7 @@ void QDKEdit::mouseMoveEvent(QMouseEvent *e)
                         currentSwitches[switchToEdit].x = newX;
                         currentSwitches[switchToEdit].y = newY;
                         mouseOverTile = QRect(newX * tileSize.width(), newY * tileSize.height(), tileSize.width()-1, tileSize.height()-1);
-                        emit dataChanged();
+                        emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                         dataIsChanged = true;
                         emit switchUpdated(switchToEdit, &currentSwitches[switchToEdit]);
                         update();
@@ -2843,7 +2221,7 @@ void QDKEdit::mouseMoveEvent(QMouseEvent *e)
                     currentSwitches[switchToEdit].connectedTo[swObjToMove].x = newX;
                     currentSwitches[switchToEdit].connectedTo[swObjToMove].y = newY;
                     mouseOverTile = QRect(newX * tileSize.width(), newY * tileSize.height(), tileSize.width()-1, tileSize.height()-1);
-                    emit dataChanged();
+                    emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                     dataIsChanged = true;
                     emit switchUpdated(switchToEdit, &currentSwitches[switchToEdit]);
                     update();
@@ -2856,6 +2234,18 @@ void QDKEdit::mouseMoveEvent(QMouseEvent *e)
 
 void QDKEdit::mousePressEvent(QMouseEvent *e)
 {
+    // the middle button drags whole tiles around
+    if (!spriteMode && (e->button() == Qt::MiddleButton))
+    {
+        createUndoData();
+        mousePressed = true;
+        QPoint cell = cellAt(e->pos());
+        tileToMove = anchorAt(cell.y() * levelDimension.width() + cell.x());
+        if (tileToMove != -1)
+            moveGrab = cell - QPoint(tileToMove % levelDimension.width(), tileToMove / levelDimension.width());
+        return;
+    }
+
     if (!switchMode)
     {
         QTileEdit::mousePressEvent(e);
@@ -2899,7 +2289,7 @@ void QDKEdit::mousePressEvent(QMouseEvent *e)
                     currentSwitches.append(newSwitch);
                     switchToEdit = currentSwitches.size() - 1;
 
-                    emit dataChanged();
+                    emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                     dataIsChanged = true;
                     emit switchAdded(&currentSwitches[currentSwitches.size()-1]);
                     update();
@@ -2955,7 +2345,7 @@ void QDKEdit::mousePressEvent(QMouseEvent *e)
 
                     currentSwitches[switchToEdit].connectedTo.append(newObj);
                     swObjToMove = currentSwitches[switchToEdit].connectedTo.size() - 1;
-                    emit dataChanged();
+                    emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                     dataIsChanged = true;
                     emit switchUpdated(switchToEdit, &currentSwitches[switchToEdit]);
                     update();
@@ -2982,7 +2372,7 @@ void QDKEdit::mousePressEvent(QMouseEvent *e)
             {
                 currentSwitches[switchToEdit].connectedTo.clear();
                 currentSwitches.removeAt(switchToEdit);
-                emit dataChanged();
+                emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                 dataIsChanged = true;
                 emit switchRemoved(switchToEdit);
                 swObjToMove = -1;
@@ -2992,7 +2382,7 @@ void QDKEdit::mousePressEvent(QMouseEvent *e)
             {
                 currentSwitches[switchToEdit].connectedTo.removeAt(swObjToMove);
                 swObjToMove = -1;
-                emit dataChanged();
+                emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
                 dataIsChanged = true;
                 emit switchUpdated(switchToEdit, &currentSwitches[switchToEdit]);
             }
@@ -3006,7 +2396,7 @@ void QDKEdit::mousePressEvent(QMouseEvent *e)
         else
             currentSwitches[switchToEdit].state = 0;
 
-        emit dataChanged();
+        emit dataChanged(QTileChange(CHANGE_SWITCHES, QRect(), switchToEdit));
         dataIsChanged = true;
         emit switchUpdated(switchToEdit, &currentSwitches[switchToEdit]);
     }
@@ -3179,81 +2569,335 @@ void QDKEdit::setupTileSelector(QTileSelector *tileSelector, float scale, int li
     tileSelector->groupTiles(groups, space);
 }
 
-void QDKEdit::undo()
+bool QDKEditStep::isEmpty() const
+{
+    return QTileEditStep::isEmpty() && oldSwitches.isEmpty() && newSwitches.isEmpty();
+}
+
+int QDKEditStep::changes() const
+{
+    if (oldSwitches.isEmpty() && newSwitches.isEmpty())
+        return QTileEditStep::changes();
+
+    return QTileEditStep::changes() | CHANGE_SWITCHES;
+}
+
+qint64 QDKEditStep::bytes() const
+{
+    qint64 bytes = QTileEditStep::bytes() + (oldSwitches.size() + newSwitches.size()) * sizeof(QDKSwitch);
+
+    for (int i = 0; i < oldSwitches.size(); i++)
+        bytes += oldSwitches.at(i).connectedTo.size() * sizeof(QDKSwitchObject);
+    for (int i = 0; i < newSwitches.size(); i++)
+        bytes += newSwitches.at(i).connectedTo.size() * sizeof(QDKSwitchObject);
+
+    return bytes;
+}
+
+static void writeSwitches(QDataStream *out, const QList<QDKSwitch> &switches)
+{
+    *out << (quint32)switches.size();
+    for (int i = 0; i < switches.size(); i++)
+    {
+        const QDKSwitch &sw = switches.at(i);
+        *out << sw.state << sw.x << sw.y << sw.levelPos << sw.ramPos;
+
+        *out << (quint32)sw.connectedTo.size();
+        for (int j = 0; j < sw.connectedTo.size(); j++)
+        {
+            const QDKSwitchObject &obj = sw.connectedTo.at(j);
+            *out << obj.x << obj.y << obj.ramPos << obj.levelPos << obj.isSprite;
+        }
+    }
+}
+
+static void readSwitches(QDataStream *in, QList<QDKSwitch> *switches)
+{
+    quint32 count, objCount;
+
+    switches->clear();
+    *in >> count;
+    for (quint32 i = 0; (i < count) && (in->status() == QDataStream::Ok); i++)
+    {
+        QDKSwitch sw;
+        *in >> sw.state >> sw.x >> sw.y >> sw.levelPos >> sw.ramPos;
+
+        *in >> objCount;
+        for (quint32 j = 0; (j < objCount) && (in->status() == QDataStream::Ok); j++)
+        {
+            QDKSwitchObject obj;
+            *in >> obj.x >> obj.y >> obj.ramPos >> obj.levelPos >> obj.isSprite;
+            sw.connectedTo.append(obj);
+        }
+
+        switches->append(sw);
+    }
+}
+
+void QDKEditStep::write(QDataStream *out) const
+{
+    QTileEditStep::write(out);
+
+    *out << (qint32)switchIndex;
+    writeSwitches(out, oldSwitches);
+    writeSwitches(out, newSwitches);
+}
+
+void QDKEditStep::read(QDataStream *in)
+{
+    QTileEditStep::read(in);
+
+    qint32 index;
+    *in >> index;
+    switchIndex = index;
+    readSwitches(in, &oldSwitches);
+    readSwitches(in, &newSwitches);
+}
+
+static bool sameSwitch(const QDKSwitch &a, const QDKSwitch &b)
 {
-    if (undoStack.size() != undoSwitches.size())
-        qWarning() << "stack sizes differ!!!";
+    if ((a.state != b.state) || (a.x != b.x) || (a.y != b.y) || (a.connectedTo.size() != b.connectedTo.size()))
+        return false;
 
+    for (int i = 0; i < a.connectedTo.size(); i++)
+        if ((a.connectedTo.at(i).x != b.connectedTo.at(i).x) || (a.connectedTo.at(i).y != b.connectedTo.at(i).y)
+                || (a.connectedTo.at(i).isSprite != b.connectedTo.at(i).isSprite))
+            return false;
+
+    return true;
+}
+
+void QDKEdit::undo()
+{
     switchToEdit = -1;
     swObjToMove = -1;
 
     QTileEdit::undo();
+}
 
-    if (undoSwitches.isEmpty())
-        return;
+void QDKEdit::redo()
+{
+    switchToEdit = -1;
+    swObjToMove = -1;
 
-    QList<QDKSwitch> undoSw = undoSwitches.pop();
+    QTileEdit::redo();
+}
 
-    for (int i = currentSwitches.size()-1; i >= 0; i--)
+void QDKEdit::rebaseUndoData()
+{
+    QTileEdit::rebaseUndoData();
+    undoBaseSwitches = currentSwitches;
+}
+
+QTileEditStep *QDKEdit::newUndoStep() const
+{
+    return new QDKEditStep();
+}
+
+void QDKEdit::diffUndoStep(QTileEditStep *step)
+{
+    QTileEdit::diffUndoStep(step);
+
+    // no more than 8 switches - comparing them is cheaper than tracking the changes
+    QDKEditStep *dkStep = static_cast<QDKEditStep *>(step);
+    diffItems(undoBaseSwitches, currentSwitches, sameSwitch, &dkStep->switchIndex, &dkStep->oldSwitches, &dkStep->newSwitches);
+}
+
+void QDKEdit::stashLevelHistory(int id)
+{
+    // unsaved edits get discarded by the level change, they stay available as redo steps
+    rewindUndoToSaved();
+
+    if (levelHistories.contains(id))
     {
-        currentSwitches[i].connectedTo.clear();
-        emit switchRemoved(i);
+        historyBytes -= levelHistories.value(id).size();
+        levelHistories.remove(id);
+        historyOrder.removeAll(id);
     }
 
-    currentSwitches.clear();
+    QByteArray history = takeUndoHistory();
+    if (history.isEmpty())
+        return;
 
-    for (int i = 0; i < undoSw.size(); i++)
+    history = qCompress(history);
+    historyBytes += history.size();
+    levelHistories.insert(id, history);
+    historyOrder.append(id);
+
+    while ((historyBytes > HISTORY_MEMORY_LIMIT) && !historyOrder.isEmpty())
     {
-        currentSwitches.append(undoSw.at(i));
-        emit switchAdded(&currentSwitches[i]);
-        undoSw[i].connectedTo.clear();
-    }    
-    undoSw.clear();
+        int oldest = historyOrder.takeFirst();
+        historyBytes -= levelHistories.value(oldest).size();
+        levelHistories.remove(oldest);
+    }
+}
 
-    update();
+void QDKEdit::restoreLevelHistory(int id)
+{
+    if (!levelHistories.contains(id))
+    {
+        clearUndoData();
+        return;
+    }
+
+    QByteArray history = levelHistories.take(id);
+    historyBytes -= history.size();
+    historyOrder.removeAll(id);
+
+    restoreUndoHistory(qUncompress(history));
 }
 
-void QDKEdit::createUndoData()
+void QDKEdit::clearLevelHistories()
 {
-    QTileEdit::createUndoData();
+    levelHistories.clear();
+    historyOrder.clear();
+    historyBytes = 0;
 
-    QList<QDKSwitch> undoSw;
+    clearUndoData();
+}
 
-    for (int i = 0; i < currentSwitches.size(); i++)
-        undoSw.append(currentSwitches.at(i));
+void QDKEdit::dropLevelHistory(int id)
+{
+    if (!levelHistories.contains(id))
+        return;
 
-    undoSwitches.push(undoSw);
+    historyBytes -= levelHistories.value(id).size();
+    levelHistories.remove(id);
+    historyOrder.removeAll(id);
 }
 
-void QDKEdit::deleteLastUndo()
+static QVector<int> levelSpriteIDs(const QDKLevel &level)
 {
-    QTileEdit::deleteLastUndo();
+    QVector<int> ids;
+    for (int i = 0; i < level.sprites.size(); i++)
+        ids.append(level.sprites.at(i).id);
 
-    if (!undoSwitches.isEmpty())
-    {
-        QList<QDKSwitch> undoSw = undoSwitches.pop();
-        for (int i = undoSw.size()-1; i >= 0; i--)
-            undoSw[i].connectedTo.clear();
-        undoSw.clear();
-    }
+    return ids;
+}
+
+// runs in a worker thread, only reads levels[id] and the tile info
+QDKReplaceResult QDKEdit::replaceInLevel(int id, bool replaceSprites, quint8 from, quint8 to)
+{
+    QDKReplaceResult result;
+    result.id = id;
+    result.skipped = 0;
+    result.level = levels[id];
+
+    countVRAMusage(result.level.tilemap, levelSpriteIDs(result.level), &result.tilesBefore, &result.spritesBefore);
+
+    if (replaceSprites)
+        result.replaced = replaceSprite(&result.level, from, to);
+    else
+        result.replaced = replaceTile(&result.level, from, to, &result.skipped);
+
+    countVRAMusage(result.level.tilemap, levelSpriteIDs(result.level), &result.tilesAfter, &result.spritesAfter);
+
+    return result;
 }
 
-void QDKEdit::clearUndoData()
+QList<QDKReplaceResult> QDKEdit::planReplace(bool replaceSprites, quint8 from, quint8 to, const QList<int> &ids)
 {
-    QTileEdit::clearUndoData();
+    QDKTraceScope trace("planReplace");
 
-    while (!undoSwitches.isEmpty())
+    QList<QDKReplaceResult> plan;
+
+    // levels without the id are left out right away
+    QList<int> levelsUsing = replaceSprites ? usage.spriteLevels(from) : usage.tileLevels(from);
+
+    QList<QFuture<QDKReplaceResult> > jobs;
+    for (int i = 0; i < ids.size(); i++)
+        if (levelsUsing.contains(ids.at(i)))
+            jobs.append(QtConcurrent::run(this, &QDKEdit::replaceInLevel, ids.at(i), replaceSprites, from, to));
+
+    for (int i = 0; i < jobs.size(); i++)
+        plan.append(jobs[i].result());
+
+    return plan;
+}
+
+int QDKEdit::applyReplace(const QList<QDKReplaceResult> &plan)
+{
+    QDKTraceScope trace("applyReplace");
+
+    QList<int> changed;
+
+    for (int i = 0; i < plan.size(); i++)
+    {
+        if (!plan.at(i).replaced)
+            continue;
+
+        int id = plan.at(i).id;
+        levels[id] = plan.at(i).level;
+        changed.append(id);
+
+        // the history was recorded against the old level
+        dropLevelHistory(id);
+        usage.updateLevel(this, id);
+    }
+
+    if (changed.isEmpty())
+        return 0;
+
+    // only the changed levels get recompressed, the journal needs them as .lvl data
+    QList<QFuture<bool> > jobs;
+    for (int i = 0; i < changed.size(); i++)
+        jobs.append(QtConcurrent::run(static_cast<QDKRom *>(this), &QDKRom::recompressLevel, (quint8)changed.at(i)));
+
+    for (int i = 0; i < jobs.size(); i++)
+        jobs[i].waitForFinished();
+
+    if (!journalPaused)
+        for (int i = 0; i < changed.size(); i++)
+        {
+            QByteArray data;
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::WriteOnly);
+            if (exportLevel(changed.at(i), &buffer))
+                journal.append(JOURNAL_LEVEL, changed.at(i), data);
+        }
+
+    // unsaved edits of the current level are dropped like on a level change
+    if (changed.contains(currentLevel))
     {
-        QList<QDKSwitch> undoSw = undoSwitches.pop();
-        for (int i = undoSw.size()-1; i >= 0; i--)
-            undoSw[i].connectedTo.clear();
-        undoSw.clear();
+        dataIsChanged = false;
+        clearUndoData();
+        changeLevel(currentLevel);
     }
+
+    return changed.size();
+}
+
+void QDKEdit::applyUndoStep(QTileEditStep *step, bool undo)
+{
+    QTileEdit::applyUndoStep(step, undo);
+    rebuildAnchors();
+
+    // the stored pixmaps may belong to another tileset by now
+    for (int i = 0; i < sprites.size(); i++)
+        sprites[i].sprite = spritePixmap(sprites.at(i).id);
+
+    QDKEditStep *dkStep = static_cast<QDKEditStep *>(step);
+    if (dkStep->oldSwitches.isEmpty() && dkStep->newSwitches.isEmpty())
+        return;
+
+    for (int i = currentSwitches.size()-1; i >= 0; i--)
+        emit switchRemoved(i);
+
+    if (undo)
+        replaceItems(&currentSwitches, dkStep->switchIndex, dkStep->newSwitches.size(), dkStep->oldSwitches);
+    else
+        replaceItems(&currentSwitches, dkStep->switchIndex, dkStep->oldSwitches.size(), dkStep->newSwitches);
+
+    for (int i = 0; i < currentSwitches.size(); i++)
+        emit switchAdded(&currentSwitches[i]);
 }
 
 
 void QDKEdit::clearLevel()
 {
+    // the switches belong to the same undo step as the tiles
+    createUndoData();
+
     for (int i = currentSwitches.size()-1; i >= 0; i--)
     {
         currentSwitches[i].connectedTo.clear();
@@ -3262,6 +2906,162 @@ void QDKEdit::clearLevel()
     currentSwitches.clear();
 
     QTileEdit::clearLevel();
+    rebuildAnchors();
+}
+
+bool QDKEdit::copySelection()
+{
+    if ((currentLevel == -1) || selection.isNull())
+        return false;
+
+    QRect area = selection & QRect(0, 0, levelDimension.width(), levelDimension.height());
+    if (area.isEmpty())
+        return false;
+
+    stamp.size = area.size();
+    stamp.cells.clear();
+    for (int y = area.top(); y <= area.bottom(); y++)
+        stamp.cells.append(lvlData.mid(lvlDataStart + (y * levelDimension.width() + area.left()) * 2, area.width() * 2));
+
+    stamp.sprites.clear();
+    for (int i = 0; i < sprites.size(); i++)
+        if (!sprites.at(i).pixelPerfect && area.contains(sprites.at(i).x, sprites.at(i).y))
+        {
+            QSprite sprite = sprites.at(i);
+            sprite.x -= area.left();
+            sprite.y -= area.top();
+            stamp.sprites.append(sprite);
+        }
+
+    stamp.switches.clear();
+    for (int i = 0; i < currentSwitches.size(); i++)
+    {
+        if (!area.contains(currentSwitches.at(i).x, currentSwitches.at(i).y))
+            continue;
+
+        QDKSwitch sw = currentSwitches.at(i);
+        sw.x -= area.left();
+        sw.y -= area.top();
+        sw.connectedTo.clear();
+
+        for (int j = 0; j < currentSwitches.at(i).connectedTo.size(); j++)
+        {
+            QDKSwitchObject obj = currentSwitches.at(i).connectedTo.at(j);
+            if (!area.contains(obj.x, obj.y))
+                continue;
+
+            obj.x -= area.left();
+            obj.y -= area.top();
+            sw.connectedTo.append(obj);
+        }
+
+        stamp.switches.append(sw);
+    }
+
+    return true;
+}
+
+bool QDKEdit::pasteSelection()
+{
+    if ((currentLevel == -1) || stamp.cells.isEmpty())
+        return false;
+
+    // pasted at the top left cell of the selection, cut at the level border
+    QPoint at = selection.isNull() ? QPoint(0, 0) : selection.topLeft();
+    QRect area = QRect(at, stamp.size) & QRect(0, 0, levelDimension.width(), levelDimension.height());
+    if (area.isEmpty())
+        return false;
+
+    // tiles, sprites and switches are one undo step
+    createUndoData();
+
+    for (int y = 0; y < area.height(); y++)
+        lvlData.replace(lvlDataStart + ((area.top() + y) * levelDimension.width() + area.left()) * 2, area.width() * 2,
+                        stamp.cells.mid(y * stamp.size.width() * 2, area.width() * 2));
+    rebuildAnchors();
+
+    // sprites and switches of the region get replaced
+    for (int i = sprites.size()-1; i >= 0; i--)
+        if (!sprites.at(i).pixelPerfect && area.contains(sprites.at(i).x, sprites.at(i).y))
+        {
+            sprites.remove(i);
+            emit spriteRemoved(i);
+        }
+
+    for (int i = 0; i < stamp.sprites.size(); i++)
+    {
+        QSprite sprite = stamp.sprites.at(i);
+        sprite.x += area.left();
+        sprite.y += area.top();
+        if (!area.contains(sprite.x, sprite.y))
+            continue;
+
+        sprite.sprite = spritePixmap(sprite.id);
+        sprites.append(sprite);
+        emit spriteAdded(spriteNumToString(sprite.id), sprite.id);
+    }
+
+    for (int i = currentSwitches.size()-1; i >= 0; i--)
+        if (area.contains(currentSwitches.at(i).x, currentSwitches.at(i).y))
+        {
+            currentSwitches.removeAt(i);
+            emit switchRemoved(i);
+        }
+
+    for (int i = 0; i < stamp.switches.size(); i++)
+    {
+        QDKSwitch sw = stamp.switches.at(i);
+        sw.x += area.left();
+        sw.y += area.top();
+        if (!area.contains(sw.x, sw.y))
+            continue;
+
+        sw.connectedTo.clear();
+        for (int j = 0; j < stamp.switches.at(i).connectedTo.size(); j++)
+        {
+            QDKSwitchObject obj = stamp.switches.at(i).connectedTo.at(j);
+            obj.x += area.left();
+            obj.y += area.top();
+            if (area.contains(obj.x, obj.y))
+                sw.connectedTo.append(obj);
+        }
+
+        updateSwitchPositions(&sw);
+        currentSwitches.append(sw);
+        emit switchAdded(&currentSwitches[currentSwitches.size()-1]);
+    }
+
+    switchToEdit = -1;
+    swObjToMove = -1;
+    spriteSelection = QRect();
+    spriteToMove = -1;
+    selectedSprite = -1;
+    emit spriteSelected(-1);
+
+    selection = area;
+    dataIsChanged = true;
+    emit dataChanged(QTileChange(CHANGE_CELLS | CHANGE_SPRITES | CHANGE_SWITCHES, area));
+    update();
+
+    commitUndoStep();
+
+    return true;
+}
+
+// level and RAM positions follow x,y
+void QDKEdit::updateSwitchPositions(QDKSwitch *sw)
+{
+    sw->levelPos = sw->y * levelDimension.width() + sw->x;
+    sw->ramPos = sw->levelPos + 0xD44D;
+
+    for (int i = 0; i < sw->connectedTo.size(); i++)
+    {
+        sw->connectedTo[i].levelPos = sw->connectedTo.at(i).y * levelDimension.width() + sw->connectedTo.at(i).x;
+        if (sw->connectedTo.at(i).isSprite)
+            sw->connectedTo[i].ramPos = sw->connectedTo.at(i).levelPos + 0xDA75;
+        else
+            sw->connectedTo[i].ramPos = sw->connectedTo.at(i).levelPos + 0xD44D;
+    }
 }
 
 bool QDKEdit::calcVRAMusageOld()
@@ -3381,8 +3181,8 @@ bool QDKEdit::calcVRAMusageOld()
     //max tiles seems to be 80
     //uses sprite space if too many tiles and sprite space still empty
     for (int i = 0; i < 255; i++)
-        for (int j = 0; j < levels[id].rawTilemap.size(); j++)
-            if (levels[id].rawTilemap[j] == (quint8)i)
+        for (int j = 0; j < levels[id].tilemap.size() / 2; j++)
+            if (rawTileAt(levels[id].tilemap, j) == (quint8)i)
             {
                 //str += QString("Tile %1; count: %2\n").arg(tileNumToString(i)).arg(tiles[i].fullCount);
                 if ((i == 0x79) || (i == 0x9E) || (i == 0x4B) || (i == 0xBB) || (i == 0xBC) || (i == 0x75) || (i == 0x77) || (i == 0xC4))
@@ -3481,69 +3281,26 @@ bool QDKEdit::calcVRAMusageOld()
 */
 }
 
-bool QDKEdit::calcVRAMusage()
+void QDKEdit::updateVRAMusage(const QTileChange &change)
 {
-    quint16 tileCount = 0;
-    quint16 spriteCount = 0;
-
-    bool elevator = false;
-    QSet<quint8> neededTiles;
-
-    // max tiles seems to be 80
-    // uses sprite space if too many tiles and sprite space still empty
-
-    // empty tile is omit on purpose
-
-    for (int i = 0; i < 255; i++)
-        for (int j = 0; j < lvlData.size(); j+=2)
-            if ((lvlData[j] == (quint8)i) && (lvlData[j+1] == (quint8)0x00))
-            {
-                // key, exit, fake exit, expandle ground/ladder, placeable block/spring, super hammer
-                // count as "sprites" - earliest VRAM pos seems to be 0x8800
-                // this may results in unused tiles before 0x8800 in VRAM
-                if ((i == 0x79) || (i == 0x9E) || (i == 0x4B) || (i == 0xBB) ||
-                    (i == 0xBC) || (i == 0x75) || (i == 0x77) || (i == 0xC4))
-                    spriteCount += tiles[i].fullCount;
-                else
-                    tileCount += tiles[i].fullCount;
-
-                if (elevator && ((i == 0x70) || (i == 0x71) || (i == 0x72) || (i == 0x73)))
-                    continue;
-
-                if ((i == 0x70) || (i == 0x71) || (i == 0x72) || (i == 0x73))
-                    elevator = true;
-
-                if (!tiles[i].needsTiles.isEmpty())
-                    for (int t = 0; t < tiles[i].needsTiles.size(); t++)
-                        neededTiles << tiles[i].needsTiles.at(t);
-
-                if (tiles[i].projectileTileCount)
-                    spriteCount += tiles[i].projectileTileCount;
-
-                break;
-            }
-
-    // max sprites seems to be 0x100
-    for (int i = 0; i < 255; i++)
-        for (int j = 0; j < sprites.size(); j++)
-            if (sprites.at(j).id == i)
-            {
-                // skip my pseudo sprites for the elevator properties
-                if ((i == 0x70) || (i == 0x72))
-                    continue;
+    // switches and properties don't take VRAM
+    if (change.what & (CHANGE_CELLS | CHANGE_SPRITES))
+        calcVRAMusage(change.what & CHANGE_CELLS);
+}
 
-                spriteCount += tiles[i].fullCount;
+bool QDKEdit::calcVRAMusage(bool tilesChanged)
+{
+    quint16 tileCount, spriteCount;
+    QVector<int> spriteIDs;
 
-                if (!tiles[i].needsTiles.isEmpty())
-                    for (int t = 0; t < tiles[i].needsTiles.size(); t++)
-                        spriteCount += tiles[tiles[i].needsTiles.at(t)].fullCount;
+    // the tilemap is only scanned again if tiles were drawn
+    if (tilesChanged || vramTileCounts.isEmpty())
+        vramTileCounts = tileCounts(lvlData);
 
-                break;
-            }
+    for (int i = 0; i < sprites.size(); i++)
+        spriteIDs.append(sprites.at(i).id);
 
-    QSet<quint8>::iterator i;
-    for (i = neededTiles.begin(); i != neededTiles.end(); ++i)
-        spriteCount += tiles[*i].fullCount;
+    countVRAMusage(vramTileCounts, spriteIDs, &tileCount, &spriteCount);
 
     if (tileCount != vramTiles)
     {
@@ -3556,4 +3313,6 @@ bool QDKEdit::calcVRAMusage()
         vramSprites = spriteCount;
         emit spriteVRAMchanged(vramSprites);
     }
+
+    return true;
 }
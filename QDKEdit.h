@@ -2,120 +2,89 @@
 #define QDKEDIT_H
 
 #include "QTileEdit.h"
+#include "QDKAssetCache.h"
+#include "QDKJournal.h"
+#include "QDKRom.h"
+#include "QDKUsageIndex.h"
 
+#include <QtCore/QCache>
 #include <QtCore/QFile>
+#include <QtCore/QFuture>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QMutex>
 #include <QtGui/QPainter>
 
-//find rombanks containing the level data
-#define ROMBANK_1 0x05
-#define COMPARE_POS_1 0x25FC  // < 0x2D
-
-#define ROMBANK_POS_2 0x25FF  // 0x06
-#define COMPARE_POS_2 0x2603  // < 0x50
-
-#define ROMBANK_POS_3 0x2606  // 0x12
-
-// some constants
-#define MAX_LEVEL_ID 256
-#define LAST_LEVEL 105
-#define MAX_TILESETS 0x22
-#define MAX_SPRITES 0x1B
-#define POINTER_TABLE 0x14000
-#define SUBTILESET_TABLE 0x30EEB
-#define SGB_SYSTEM_PAL 0x786F0 // decompressed size 0x1000
-// the SGB packet is always 51.(quint16)var+0x80.E4 00.E5.00.E6 00.C1.00.00 00.00.00.00
-// asm @ 0x0E70
-#define PAL_ARCADE 0x30F9A
-// the palette for the 4 arcade levels are @ 0x4F9A (bank 0x0C) + (6*id)
-// this value is palette index + 0xC8
-// not freely editable!
-#define PAL_TABLE 0x6093B
-// PAL_TABLE + (id-4)*8
-// palettes for all other levels
-
-// BGP depends on tileset asm @ 0E9D
-#define TILE_INDEX_TABLE 0x60E5
-#define ADDITIONAL_TILES_TABLE 0x30E55
-
-#define VRAM_TILES 0x50
-#define VRAM_SPRITES 0x100
-
-#define ELEVATOR_TABLE 0x30F77
-class QMouseEvent;
-
-struct QDKSprite : QSprite
-{
-    quint16 ramPos;
-    quint32 levelPos;
-//    quint8 addFlag;
-};
+// number of recoloured tilesets kept around for quick level switching
+#define RENDER_CACHE_SIZE 8
+// tilesets of the levels this close to the current one are built in the background
+// 0 disables prefetching
+#define TILESET_PREFETCH_RANGE 1
+// compressed undo histories of the levels not being edited, least recently edited ones are dropped first
+#define HISTORY_MEMORY_LIMIT (1024 * 1024)
 
-struct QDKSwitchObject
-{
-    quint8 x, y;
-    quint16 ramPos;
-    quint32 levelPos;
-    bool isSprite;
-};
-
-struct QDKSwitch
-{
-    quint8 state;
-    quint8 x, y;
-    quint32 levelPos;
-    quint16 ramPos;
-    QList<QDKSwitchObject> connectedTo;
-};
+class QMouseEvent;
+class QCryptographicHash;
 
 typedef QColor QGBPalette[4];
 
-struct QDKLevel
+// everything updateTileset produces for one tileset/palette/BGP combination
+struct QDKRenderedTileset
 {
-    quint8 id; // max 256 !
-    quint8 rombank;
-    quint32 offset;
+    ~QDKRenderedTileset() { qDeleteAll(spritePix[0]); qDeleteAll(spritePix[1]); }
 
-    quint8 size; // 0x00 -> 0x240 bytes for tilemap else 0x380 bytes
-    quint8 music;
-    quint8 tileset;
-    quint16 time;
-
-    bool switchData;
-    bool addSpriteData;
-    bool fullDataUpToDate;
+    int tileset;
+    quint16 palIndex;
+    QPixmap tileSet;
+    QImage selectorImage; // arranged tiles of the tile selector
+    QMap<QString, QPixmap *> spritePix[2]; // opaque and transparent variant
+};
 
-    QByteArray rawTilemap;
-    QByteArray displayTilemap;
-    quint16 paletteIndex;
+typedef QMap<QString, QImage> QDKSpriteImages;
 
-    QList<QDKSprite> sprites;
-    QList<QDKSwitch> switches;
+// decode a tile into an indexed image at pixel position x, y
+void decodeTileToImage(const uchar *src, QImage *img, int x, int y);
 
-    QByteArray rawSwitchData; // 0x11 + 0x90 bytes
-    QByteArray rawAddSpriteData; // 0x40 bytes
+// undo step with the switch changes
+struct QDKEditStep : QTileEditStep
+{
+    QDKEditStep() : switchIndex(0) {}
+    bool isEmpty() const;
+    int changes() const;
+    qint64 bytes() const;
+    void write(QDataStream *out) const;
+    void read(QDataStream *in);
+
+    int switchIndex; // oldSwitches got replaced by newSwitches at this index
+    QList<QDKSwitch> oldSwitches;
+    QList<QDKSwitch> newSwitches;
+};
 
-    QByteArray fullData;
+// rectangular part of a level for copy and paste between levels
+// positions are relative to the top left cell
+struct QDKStamp
+{
+    QSize size;
+    QByteArray cells; // 16 bit display tilemap cells row by row, super tile parts included
+    QVector<QSprite> sprites;
+    QList<QDKSwitch> switches; // only the connected objects inside the region
 };
 
-struct QTileInfo
+// find and replace outcome for one level, applied once confirmed
+struct QDKReplaceResult
 {
-    quint8 w, h;
-    quint8 type; // that's a bit vague - this is the pointer+N value
-    quint8 count;
-    quint8 fullCount;
-    quint8 setSpecific;
-    quint16 additionalTilesAt;
-    quint32 romOffset;
-    QList<int> needsTiles;
-    quint8 projectileTileCount;
-    bool compressed;
+    int id;
+    int replaced;
+    int skipped; // super tiles without room for their footprint
+    quint16 tilesBefore, spritesBefore;
+    quint16 tilesAfter, spritesAfter; // VRAM usage
+    QDKLevel level; // copy with the replacement done
 };
 
-class QDKEdit : public QTileEdit
+class QDKEdit : public QTileEdit, public QDKRom
 {
     Q_OBJECT
+    friend class QDKBenchmark;
 public:
     explicit QDKEdit(QWidget *parent = 0);
     ~QDKEdit();
@@ -123,44 +92,75 @@ public:
     bool saveAllLevels(QString romFile);
     bool exportCurrentLevel(QString filename);
     bool importLevel(QString filename);
+    bool hasJournal();
+    int replayJournal();
+    void discardJournal();
     QString getLevelInfo();
     void fillSpriteNames();
     void fillTileNames();
     void setupTileSelector(QTileSelector *tileSelector, float scale, int limitTileCount);
+    QImage spriteImage(int id);
+    void memoryUsage(QDKMemoryReport *report);
+    const QDKUsageIndex *usageIndex() const { return &usage; }
+    int getCurrentLevel() const { return currentLevel; }
+    QList<QDKReplaceResult> planReplace(bool replaceSprites, quint8 from, quint8 to, const QList<int> &ids);
+    int applyReplace(const QList<QDKReplaceResult> &plan);
 
 private:
     void paintLevel(QPainter *painter);
     void mouseMoveEvent(QMouseEvent *e);
     void mousePressEvent(QMouseEvent *e);
-    QByteArray LZSSDecompress(QDataStream *in, quint16 decompressedSize);
-    QByteArray LZSSCompress(QByteArray *src);
-    bool readLevel(QFile *src, quint8 id, bool fromLvlFile = false);
-    bool readSGBPalettes(QFile *src);
-    bool recompressLevel(quint8 id);
-    bool expandRawTilemap(quint8 id);
-    bool updateRawTilemap(quint8 id);
-    void copyTileToSet(QFile *src, quint32 offset, QImage *img, quint16 tileID, quint8 tileSetID, bool compressed, quint8 tileCount, quint16 superOffset);
-    bool getTileInfo(QFile *src);
-    bool createTileSets(QFile *src, QGBPalette palette);
-    bool createSprites(QFile *src, QGBPalette palette);
+    void copyTileToSet(QIODevice *src, quint32 offset, QImage *img, quint16 tileID, quint8 tileSetID, bool compressed, quint8 tileCount, quint16 superOffset);
+    bool createTileSets();
+    bool createSprites();
+    void hashTileSource(QCryptographicHash *hash, QIODevice *src, quint8 tileID, quint8 tileSetID, int dataSize);
+    void hashAssetSources(QIODevice *src);
+    bool assetCached(quint32 key);
+    bool writeAssetCache();
+    QImage buildBaseTileset(QIODevice *src);
+    QImage buildTileset(int id);
+    QDKSpriteImages buildSprites(int set);
+    void requestTileset(int id);
+    void waitForTileset(int id);
+    void prefetchTilesets(int level);
+    void waitForSprites(int set);
     void sortSprite(QImage *sprite, int id);
     void copyTile(QImage *img, int x1, int y1, int x2, int y2, bool mirror);
     void fillTile(QImage *img, int x, int y, int index);
     void swapTiles(QImage *img, int x1, int y1, int x2, int y2);
-    QMap<QString, QPixmap *> spritePix;
     QMap<QString, QImage *> spriteImg;
+    QString spriteKey(int id, int tileset);
+    QPixmap *spritePixmap(int id);
+    QDKRenderedTileset *renderTileset(int tileset, quint16 palIndex, quint8 bgp);
+    void renderSprites(QDKRenderedTileset *render, bool transparent);
     void updateTileset();
-    quint8 getSpriteDefaultFlag(int id);
-    void rebuildAddSpriteData(int id);
-    void rebuildSwitchData(int id);
+    qint64 imageBytes(const QImage &img) const;
+    qint64 renderedBytes(const QDKRenderedTileset *render) const;
+    QCache<quint32, QDKRenderedTileset> renderCache;
+    QHash<quint32, qint64> renderCacheBytes; // looking into the cache would reorder it
+    QDKRenderedTileset *currentRender;
+    quint32 currentRenderKey;
     quint16 vramTiles;
     quint16 vramSprites;
+    QVector<quint16> vramTileCounts; // cells per tile id in lvlData, kept for sprite only changes
 
-    QDKLevel levels[MAX_LEVEL_ID];
+    QDKAssetCache assetCache; // has to outlive the images using its pixels
+    QHash<quint32, quint64> assetHashes; // hash of the rom data every entry is built from
+    bool assetsBuilt;
     QImage tilesets[MAX_TILESETS];
+    QByteArray baseRomData;
+    QVector<QRgb> fallbackColors;
+    QImage baseTileset;
+    QMutex baseTilesetMutex;
+    QFuture<QImage> tilesetJobs[MAX_TILESETS];
+    QFuture<QDKSpriteImages> spriteJobs[MAX_TILESETS + 1]; // shared sprites + one per tileset
+    bool tilesetRequested[MAX_TILESETS];
+    bool tilesetReady[MAX_TILESETS];
+    bool spritesReady[MAX_TILESETS + 1];
     quint8 tilesetBGP[MAX_TILESETS];
-    QTileInfo tiles[256];
-    QGBPalette sgbPal[512];
+    QRgb sgbPal[512][4]; // SGB system palettes as packed colours
+    void packSGBPalettes();
+    QVector<QRgb> paletteTable(quint16 palIndex, quint8 paletteByte);
     int currentLevel;
 
     quint8 currentSize; // 0x00 -> 0x240 bytes for tilemap else 0x380 bytes
@@ -174,11 +174,48 @@ private:
     int swObjToMove;
 
     QList<QDKSwitch> currentSwitches;
-    QStack<QList<QDKSwitch> > undoSwitches;
+    QDKStamp stamp; // kept when the level is changed
+    QDKUsageIndex usage; // follows the saved levels
+    void updateSwitchPositions(QDKSwitch *sw);
+    QList<QDKSwitch> undoBaseSwitches;
+    void rebaseUndoData();
+    QTileEditStep *newUndoStep() const;
+    void diffUndoStep(QTileEditStep *step);
+    void applyUndoStep(QTileEditStep *step, bool undo);
+    QSize tileFootprint(int tileNumber);
+    void expandTile(int x, int y, int tileNumber);
+
+    // owning tile of every cell, the cells of a super tile point to its top left cell
+    // -1 for empty cells, kept up to date by setTile and expandTile
+    QVector<qint16> anchors;
+    int tileToMove; // anchor dragged with the middle button, -1 if none
+    QPoint moveGrab; // grabbed cell relative to the anchor
+    void rebuildAnchors();
+    int anchorAt(int offset) const;
+    void eraseTile(int anchor);
+    bool moveTile(int anchor, int target);
+    using QTileEdit::setTile;
+    void setTile(int offset, int tileNumber);
+    QRect hoverRect(int x, int y);
+
+    QMap<int, QByteArray> levelHistories; // qCompressed takeUndoHistory of inactive levels
+    QList<int> historyOrder; // least recently edited first
+    qint64 historyBytes;
+    void stashLevelHistory(int id);
+    void restoreLevelHistory(int id);
+    void clearLevelHistories();
+    void dropLevelHistory(int id);
+    QDKReplaceResult replaceInLevel(int id, bool replaceSprites, quint8 from, quint8 to);
+
+    QDKJournal journal;
+    QList<QDKJournalRecord> pendingJournal; // left over from an earlier session
+    bool journalPaused;
+    bool importLevel(QIODevice *src);
+    void journalUndoStep(const QTileEditStep *step, bool undo);
+    void journalProperties(int id, quint8 size, quint8 music, quint8 tileset, quint16 time, quint16 palIndex);
 
     bool romLoaded;
     bool transparentSprites;
-    static bool isSprite[256];
 
 signals:
     void paletteChanged(int palette);
@@ -196,11 +233,10 @@ private slots:
     void checkForLargeTile(int x, int y, int drawnTile);
     void updateSprite(int num);
     void undo();
-    void createUndoData();
-    void clearUndoData();
-    void deleteLastUndo();
+    void redo();
     bool calcVRAMusageOld();
-    bool calcVRAMusage();
+    bool calcVRAMusage(bool tilesChanged = true);
+    void updateVRAMusage(const QTileChange &change);
     
 public slots:
     void changeLevel(int id);
@@ -214,6 +250,8 @@ public slots:
     void addSprite(int id);
 
     void clearLevel();
+    bool copySelection();
+    bool pasteSelection();
 
     void toggleSwitchMode(bool enabled);
     void toggleSwitchMode(int enabled);
@@ -0,0 +1,231 @@
+#include "QDKJournal.h"
+#include "QDKTrace.h"
+
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtConcurrentRun>
+
+#include <string.h>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define JOURNAL_RECORD_HEADER 8
+
+QDKJournal::QDKJournal(QObject *parent) :
+    QObject(parent), validSize(-1)
+{
+    syncTimer.setSingleShot(true);
+    syncTimer.setInterval(JOURNAL_SYNC_INTERVAL);
+    connect(&syncTimer, SIGNAL(timeout()), this, SLOT(sync()));
+}
+
+QDKJournal::~QDKJournal()
+{
+    close();
+}
+
+void QDKJournal::open(QString romFile, const QByteArray &romHash)
+{
+    close();
+
+    // the file is only created once something gets appended
+    file.setFileName(romFile + JOURNAL_SUFFIX);
+    hash = romHash;
+    validSize = -1;
+}
+
+void QDKJournal::close()
+{
+    syncTimer.stop();
+    syncJob.waitForFinished();
+
+    if (!pending.isEmpty() && (file.isOpen() || create()))
+        writeRecords(&file, pending);
+
+    pending.clear();
+    file.close();
+}
+
+QList<QDKJournalRecord> QDKJournal::records()
+{
+    QDKTraceScope trace("readJournal");
+
+    QList<QDKJournalRecord> list;
+
+    QFile in(file.fileName());
+    if (!in.open(QIODevice::ReadOnly))
+        return list;
+
+    QByteArray data = in.readAll();
+    in.close();
+
+    QDataStream stream(data);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    char magic[4];
+    quint32 version;
+    QByteArray romHash;
+
+    if ((stream.readRawData(magic, 4) != 4) || memcmp(magic, JOURNAL_MAGIC, 4))
+        return list;
+
+    stream >> version >> romHash;
+    if ((version != JOURNAL_VERSION) || (romHash != hash))
+    {
+        qWarning() << QString("Journal %1 doesn't belong to the loaded rom").arg(file.fileName());
+        return list;
+    }
+
+    quint32 size;
+    quint16 crc;
+    qint64 pos = stream.device()->pos();
+
+    while (pos + JOURNAL_RECORD_HEADER <= data.size())
+    {
+        stream >> size >> crc;
+
+        // the last record may have been cut off by a crash
+        if (pos + JOURNAL_RECORD_HEADER + size > (qint64)data.size())
+            break;
+
+        const char *record = data.constData() + pos + 6;
+        if (qChecksum(record, size + 2) != crc)
+        {
+            qWarning() << QString("Journal %1: damaged record at 0x%2, ignoring the rest").arg(file.fileName()).arg(pos, 0, 16);
+            break;
+        }
+
+        QDKJournalRecord entry;
+        entry.type = record[0];
+        entry.level = record[1];
+        entry.data = QByteArray(record + 2, size);
+        list.append(entry);
+
+        pos += JOURNAL_RECORD_HEADER + size;
+        stream.device()->seek(pos);
+    }
+
+    // new records go after the last intact one
+    validSize = pos;
+
+    return list;
+}
+
+void QDKJournal::append(quint8 type, quint8 level, const QByteArray &data)
+{
+    if (file.fileName().isEmpty())
+        return;
+
+    QByteArray record;
+    record.append((char)type);
+    record.append((char)level);
+    record.append(data);
+
+    QDataStream out(&pending, QIODevice::WriteOnly | QIODevice::Append);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out << (quint32)data.size() << qChecksum(record.constData(), record.size());
+    out.writeRawData(record.constData(), record.size());
+
+    if (!syncTimer.isActive())
+        syncTimer.start();
+}
+
+void QDKJournal::clear()
+{
+    syncTimer.stop();
+    syncJob.waitForFinished();
+
+    pending.clear();
+    file.close();
+    validSize = -1;
+
+    if (file.exists())
+        file.remove();
+}
+
+void QDKJournal::sync()
+{
+    if (pending.isEmpty())
+        return;
+
+    // the previous batch is still being written
+    if (syncJob.isRunning())
+    {
+        syncTimer.start();
+        return;
+    }
+
+    if (!file.isOpen() && !create())
+    {
+        qWarning() << QString("Could not write journal %1").arg(file.fileName());
+        pending.clear();
+        return;
+    }
+
+    syncJob = QtConcurrent::run(writeRecords, &file, pending);
+    pending.clear();
+}
+
+bool QDKJournal::create()
+{
+    // appending to a journal of the same rom keeps the earlier records
+    bool keep = false;
+
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&file);
+        in.setByteOrder(QDataStream::LittleEndian);
+
+        char magic[4];
+        quint32 version;
+        QByteArray romHash;
+
+        if ((in.readRawData(magic, 4) == 4) && !memcmp(magic, JOURNAL_MAGIC, 4))
+        {
+            in >> version >> romHash;
+            keep = (version == JOURNAL_VERSION) && (romHash == hash);
+        }
+
+        file.close();
+    }
+
+    if (keep)
+    {
+        if (!file.open(QIODevice::ReadWrite))
+            return false;
+
+        if (validSize > 0)
+            file.resize(validSize);
+
+        return file.seek(file.size());
+    }
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(JOURNAL_MAGIC, 4);
+    out << (quint32)JOURNAL_VERSION << hash;
+    file.flush();
+
+    return true;
+}
+
+void QDKJournal::writeRecords(QFile *file, QByteArray data)
+{
+    QDKTraceScope trace("syncJournal");
+
+    file->write(data);
+    file->flush();
+
+#ifdef Q_OS_WIN
+    _commit(file->handle());
+#else
+    fsync(file->handle());
+#endif
+}
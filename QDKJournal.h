@@ -0,0 +1,67 @@
+#ifndef QDKJOURNAL_H
+#define QDKJOURNAL_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFile>
+#include <QtCore/QFuture>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+#define JOURNAL_SUFFIX ".journal"
+#define JOURNAL_MAGIC "eDKJ"
+#define JOURNAL_VERSION 1
+// appended records are written and synced to disk in batches
+#define JOURNAL_SYNC_INTERVAL 500 // ms
+
+/* file layout (little endian):
+   header: magic (4) | version (4) | rom hash length (4) | md5 of the rom file
+   record: payload size (4) | CRC-16 of type, level and payload (2) | type (1) | level (1) | payload
+   a record that is cut off or fails the CRC ends the journal
+*/
+
+enum
+{
+    JOURNAL_STEP = 1, // QDKEditStep, applied forward
+    JOURNAL_UNDO = 2, // QDKEditStep, applied backward
+    JOURNAL_PROPERTIES = 3, // size, music, tileset, time, palette
+    JOURNAL_LEVEL = 4 // palette byte + level data as in a .lvl file
+};
+
+struct QDKJournalRecord
+{
+    quint8 type;
+    quint8 level;
+    QByteArray data;
+};
+
+// append only edit log next to the rom, replayed after a crash
+class QDKJournal : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QDKJournal(QObject *parent = 0);
+    ~QDKJournal();
+
+    void open(QString romFile, const QByteArray &romHash);
+    void close();
+    QList<QDKJournalRecord> records();
+    void append(quint8 type, quint8 level, const QByteArray &data);
+    void clear();
+
+public slots:
+    void sync();
+
+private:
+    bool create();
+    static void writeRecords(QFile *file, QByteArray data);
+
+    QFile file;
+    QByteArray hash;
+    QByteArray pending;
+    qint64 validSize; // end of the last intact record, -1 until the records are read
+    QFuture<void> syncJob;
+    QTimer syncTimer;
+};
+
+#endif // QDKJOURNAL_H
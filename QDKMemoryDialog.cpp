@@ -0,0 +1,89 @@
+#include "QDKMemoryDialog.h"
+#include "QDKEdit.h"
+
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+QDKMemoryDialog::QDKMemoryDialog(QDKEdit *edit, QWidget *parent) :
+    QDialog(parent), edit(edit)
+{
+    setWindowTitle("Memory usage");
+    resize(360, 480);
+
+    tree = new QTreeWidget(this);
+    tree->setColumnCount(2);
+    tree->setHeaderLabels(QStringList() << "Category" << "Size");
+    tree->setRootIsDecorated(true);
+
+    QPushButton *btnRefresh = new QPushButton("Refresh", this);
+    connect(btnRefresh, SIGNAL(clicked()), this, SLOT(refresh()));
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(tree);
+    layout->addWidget(btnRefresh);
+
+    refresh();
+}
+
+void QDKMemoryDialog::refresh()
+{
+    QDKMemoryReport report;
+    edit->memoryUsage(&report);
+
+    tree->clear();
+
+    QTreeWidgetItem *item;
+    qint64 total = 0;
+
+    QMap<QString, qint64>::const_iterator i;
+    for (i = report.categories.constBegin(); i != report.categories.constEnd(); ++i)
+    {
+        item = new QTreeWidgetItem(tree);
+        item->setText(0, i.key());
+        item->setText(1, formatBytes(i.value()));
+        item->setTextAlignment(1, Qt::AlignRight);
+        total += i.value();
+    }
+
+    // per level sums of the "levels: " categories
+    QTreeWidgetItem *levels = new QTreeWidgetItem(tree);
+    levels->setText(0, "levels");
+
+    qint64 levelTotal = 0;
+    for (int id = 0; id < MAX_LEVEL_ID; id++)
+    {
+        if (!report.levels[id])
+            continue;
+
+        item = new QTreeWidgetItem(levels);
+        item->setText(0, QString("Level 0x%1").arg(id, 2, 16, QChar('0')));
+        item->setText(1, formatBytes(report.levels[id]));
+        item->setTextAlignment(1, Qt::AlignRight);
+        levelTotal += report.levels[id];
+    }
+
+    levels->setText(1, formatBytes(levelTotal));
+    levels->setTextAlignment(1, Qt::AlignRight);
+
+    item = new QTreeWidgetItem(tree);
+    item->setText(0, "total");
+    item->setText(1, formatBytes(total));
+    item->setTextAlignment(1, Qt::AlignRight);
+    QFont font = item->font(0);
+    font.setBold(true);
+    item->setFont(0, font);
+    item->setFont(1, font);
+
+    tree->resizeColumnToContents(0);
+}
+
+QString QDKMemoryDialog::formatBytes(qint64 bytes)
+{
+    if (bytes < 1024)
+        return QString("%1 B").arg(bytes);
+    if (bytes < 1024 * 1024)
+        return QString("%1 KiB").arg(bytes / 1024.0, 0, 'f', 1);
+
+    return QString("%1 MiB").arg(bytes / (1024.0 * 1024.0), 0, 'f', 2);
+}
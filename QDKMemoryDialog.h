@@ -0,0 +1,26 @@
+#ifndef QDKMEMORYDIALOG_H
+#define QDKMEMORYDIALOG_H
+
+#include <QDialog>
+
+class QDKEdit;
+class QTreeWidget;
+
+// debug panel listing the bytes QDKEdit holds per category and per level
+class QDKMemoryDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit QDKMemoryDialog(QDKEdit *edit, QWidget *parent = 0);
+
+public slots:
+    void refresh();
+
+private:
+    static QString formatBytes(qint64 bytes);
+
+    QDKEdit *edit;
+    QTreeWidget *tree;
+};
+
+#endif // QDKMEMORYDIALOG_H
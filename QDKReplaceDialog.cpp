@@ -0,0 +1,193 @@
+#include "QDKReplaceDialog.h"
+
+#include <QCheckBox>
+#include <QComboBox>
+#include <QFormLayout>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QListWidget>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+QDKReplaceDialog::QDKReplaceDialog(QDKEdit *edit, QWidget *parent) :
+    QDialog(parent), edit(edit)
+{
+    setWindowTitle("Replace in levels");
+    resize(520, 480);
+
+    cmbKind = new QComboBox(this);
+    cmbKind->addItems(QStringList() << "Tile" << "Sprite");
+    txtFrom = new QLineEdit(this);
+    txtFrom->setPlaceholderText("id, e.g. 0x2A");
+    txtTo = new QLineEdit(this);
+    txtTo->setPlaceholderText("id, e.g. 0x2B");
+
+    connect(cmbKind, SIGNAL(currentIndexChanged(int)), this, SLOT(discardPlan()));
+    connect(txtFrom, SIGNAL(textChanged(QString)), this, SLOT(discardPlan()));
+    connect(txtTo, SIGNAL(textChanged(QString)), this, SLOT(discardPlan()));
+    // a preview is only valid for the levels it was made from
+    connect(edit, SIGNAL(dataChanged(QTileChange)), this, SLOT(levelChanged(QTileChange)));
+
+    QFormLayout *query = new QFormLayout();
+    query->addRow("Replace", cmbKind);
+    query->addRow("From", txtFrom);
+    query->addRow("To", txtTo);
+
+    lstLevels = new QListWidget(this);
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        QListWidgetItem *item = new QListWidgetItem(QString("Level 0x%1").arg(i, 2, 16, QChar('0')), lstLevels);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Checked);
+    }
+    connect(lstLevels, SIGNAL(itemChanged(QListWidgetItem*)), this, SLOT(discardPlan()));
+
+    QCheckBox *ckbAll = new QCheckBox("All levels", this);
+    ckbAll->setChecked(true);
+    connect(ckbAll, SIGNAL(toggled(bool)), this, SLOT(selectAll(bool)));
+
+    QVBoxLayout *levels = new QVBoxLayout();
+    levels->addWidget(ckbAll);
+    levels->addWidget(lstLevels);
+
+    tree = new QTreeWidget(this);
+    tree->setColumnCount(5);
+    tree->setHeaderLabels(QStringList() << "Level" << "Replaced" << "Skipped" << "VRAM tiles" << "VRAM sprites");
+    tree->setRootIsDecorated(false);
+
+    QHBoxLayout *lists = new QHBoxLayout();
+    lists->addLayout(levels, 1);
+    lists->addWidget(tree, 3);
+
+    lblResult = new QLabel(this);
+
+    QPushButton *btnPreview = new QPushButton("Preview", this);
+    connect(btnPreview, SIGNAL(clicked()), this, SLOT(preview()));
+    btnApply = new QPushButton("Apply", this);
+    btnApply->setEnabled(false);
+    connect(btnApply, SIGNAL(clicked()), this, SLOT(apply()));
+    QPushButton *btnClose = new QPushButton("Close", this);
+    connect(btnClose, SIGNAL(clicked()), this, SLOT(close()));
+
+    QHBoxLayout *buttons = new QHBoxLayout();
+    buttons->addWidget(lblResult, 1);
+    buttons->addWidget(btnPreview);
+    buttons->addWidget(btnApply);
+    buttons->addWidget(btnClose);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(query);
+    layout->addLayout(lists);
+    layout->addLayout(buttons);
+}
+
+bool QDKReplaceDialog::readID(QLineEdit *field, int *id)
+{
+    bool ok;
+    *id = field->text().toInt(&ok, 0);
+
+    return ok && (*id >= 0) && (*id <= 0xFF);
+}
+
+void QDKReplaceDialog::preview()
+{
+    discardPlan();
+
+    int from, to;
+    if (!readID(txtFrom, &from) || !readID(txtTo, &to))
+    {
+        lblResult->setText("Invalid id");
+        return;
+    }
+
+    bool replaceSprites = (cmbKind->currentIndex() == 1);
+    if (replaceSprites && !QDKRom::isSprite[to])
+    {
+        lblResult->setText(QString("0x%1 is no sprite").arg(to, 2, 16, QChar('0')));
+        return;
+    }
+
+    QList<int> ids;
+    for (int i = 0; i < lstLevels->count(); i++)
+        if (lstLevels->item(i)->checkState() == Qt::Checked)
+            ids.append(i);
+
+    plan = edit->planReplace(replaceSprites, from, to, ids);
+
+    int replaced = 0;
+    int levels = 0;
+
+    for (int i = 0; i < plan.size(); i++)
+    {
+        const QDKReplaceResult &result = plan.at(i);
+        if (!result.replaced && !result.skipped)
+            continue;
+
+        QTreeWidgetItem *item = new QTreeWidgetItem(tree);
+        item->setText(0, QString("Level 0x%1").arg(result.id, 2, 16, QChar('0')));
+        item->setText(1, QString::number(result.replaced));
+        item->setText(2, QString::number(result.skipped));
+        item->setText(3, QString("%1 -> %2").arg(result.tilesBefore).arg(result.tilesAfter));
+        item->setText(4, QString("%1 -> %2").arg(result.spritesBefore).arg(result.spritesAfter));
+
+        // same limits as the VRAM bars of the main window
+        if (result.tilesAfter >= (VRAM_SPRITES - result.spritesAfter) + VRAM_TILES)
+            item->setForeground(3, Qt::red);
+        else if (result.tilesAfter > VRAM_TILES)
+            item->setForeground(3, QColor(0xFF, 0xA0, 0x00));
+
+        if (result.spritesAfter > VRAM_SPRITES)
+            item->setForeground(4, Qt::red);
+
+        replaced += result.replaced;
+        if (result.replaced)
+            levels++;
+    }
+
+    for (int i = 0; i < tree->columnCount(); i++)
+        tree->resizeColumnToContents(i);
+
+    lblResult->setText(QString("%1 replacements in %2 levels").arg(replaced).arg(levels));
+    btnApply->setEnabled(replaced > 0);
+}
+
+void QDKReplaceDialog::apply()
+{
+    // the editor reloads the current level, which discards the plan
+    QList<QDKReplaceResult> confirmed = plan;
+    int levels = edit->applyReplace(confirmed);
+
+    discardPlan();
+    lblResult->setText(QString("%1 levels changed").arg(levels));
+}
+
+void QDKReplaceDialog::levelChanged(const QTileChange &change)
+{
+    if (plan.isEmpty())
+        return;
+
+    // applying drops unsaved edits of the current level, so those invalidate the preview too
+    bool current = false;
+    for (int i = 0; i < plan.size(); i++)
+        if (plan.at(i).replaced && (plan.at(i).id == edit->getCurrentLevel()))
+            current = true;
+
+    if ((change.what & CHANGE_LEVEL) || current)
+        discardPlan();
+}
+
+void QDKReplaceDialog::discardPlan()
+{
+    plan.clear();
+    tree->clear();
+    lblResult->clear();
+    btnApply->setEnabled(false);
+}
+
+void QDKReplaceDialog::selectAll(bool checked)
+{
+    for (int i = 0; i < lstLevels->count(); i++)
+        lstLevels->item(i)->setCheckState(checked ? Qt::Checked : Qt::Unchecked);
+}
@@ -0,0 +1,44 @@
+#ifndef QDKREPLACEDIALOG_H
+#define QDKREPLACEDIALOG_H
+
+#include <QDialog>
+
+#include "QDKEdit.h"
+
+class QComboBox;
+class QLabel;
+class QLineEdit;
+class QListWidget;
+class QPushButton;
+class QTreeWidget;
+
+// replaces a tile or sprite id in the selected levels
+// the VRAM usage of every affected level is shown before anything is changed
+class QDKReplaceDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit QDKReplaceDialog(QDKEdit *edit, QWidget *parent = 0);
+
+private slots:
+    void preview();
+    void apply();
+    void levelChanged(const QTileChange &change);
+    void discardPlan();
+    void selectAll(bool checked);
+
+private:
+    bool readID(QLineEdit *field, int *id);
+
+    QDKEdit *edit;
+    QComboBox *cmbKind;
+    QLineEdit *txtFrom;
+    QLineEdit *txtTo;
+    QListWidget *lstLevels;
+    QTreeWidget *tree;
+    QLabel *lblResult;
+    QPushButton *btnApply;
+    QList<QDKReplaceResult> plan;
+};
+
+#endif // QDKREPLACEDIALOG_H
@@ -0,0 +1,100 @@
+#include "QDKUsageDialog.h"
+#include "QDKEdit.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QComboBox>
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLineEdit>
+#include <QPushButton>
+#include <QTreeWidget>
+#include <QVBoxLayout>
+
+QDKUsageDialog::QDKUsageDialog(QDKEdit *edit, QWidget *parent) :
+    QDialog(parent), edit(edit)
+{
+    setWindowTitle("Find usage");
+    resize(360, 480);
+
+    cmbKind = new QComboBox(this);
+    cmbKind->addItems(QStringList() << "Tile" << "Sprite");
+
+    txtID = new QLineEdit(this);
+    txtID->setPlaceholderText("id, e.g. 0x2A");
+    connect(txtID, SIGNAL(returnPressed()), this, SLOT(search()));
+
+    QPushButton *btnFind = new QPushButton("Find", this);
+    connect(btnFind, SIGNAL(clicked()), this, SLOT(search()));
+
+    tree = new QTreeWidget(this);
+    tree->setColumnCount(2);
+    tree->setHeaderLabels(QStringList() << "Level" << "Uses");
+    connect(tree, SIGNAL(itemDoubleClicked(QTreeWidgetItem*,int)), this, SLOT(openLevel(QTreeWidgetItem*)));
+
+    lblResult = new QLabel(this);
+
+    QHBoxLayout *query = new QHBoxLayout();
+    query->addWidget(cmbKind);
+    query->addWidget(txtID);
+    query->addWidget(btnFind);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addLayout(query);
+    layout->addWidget(tree);
+    layout->addWidget(lblResult);
+}
+
+void QDKUsageDialog::search()
+{
+    tree->clear();
+
+    bool ok;
+    int id = txtID->text().toInt(&ok, 0);
+    if (!ok || (id < 0) || (id > 0xFF))
+    {
+        lblResult->setText("Invalid id");
+        return;
+    }
+
+    // the index follows saveLevel, unsaved changes of the current level are not in it yet
+    QElapsedTimer timer;
+    timer.start();
+
+    const QDKUsageIndex *index = edit->usageIndex();
+    const QVector<QDKUsage> &uses = (cmbKind->currentIndex() == 0) ? index->tileUsage(id) : index->spriteUsage(id);
+
+    qint64 ns = timer.nsecsElapsed();
+
+    QTreeWidgetItem *level = NULL;
+    QTreeWidgetItem *item;
+    int levels = 0;
+
+    for (int i = 0; i < uses.size(); i++)
+    {
+        if (!level || (level->data(0, Qt::UserRole).toInt() != uses.at(i).level))
+        {
+            if (level)
+                level->setText(1, QString::number(level->childCount()));
+
+            level = new QTreeWidgetItem(tree);
+            level->setText(0, QString("Level 0x%1").arg((int)uses.at(i).level, 2, 16, QChar('0')));
+            level->setData(0, Qt::UserRole, (int)uses.at(i).level);
+            levels++;
+        }
+
+        item = new QTreeWidgetItem(level);
+        item->setText(0, QString("%1x%2").arg((int)uses.at(i).x).arg((int)uses.at(i).y));
+        item->setData(0, Qt::UserRole, (int)uses.at(i).level);
+    }
+
+    if (level)
+        level->setText(1, QString::number(level->childCount()));
+
+    tree->resizeColumnToContents(0);
+    lblResult->setText(QString("%1 uses in %2 levels (%3 us)").arg(uses.size()).arg(levels).arg(ns / 1000.0, 0, 'f', 1));
+}
+
+void QDKUsageDialog::openLevel(QTreeWidgetItem *item)
+{
+    emit levelSelected(item->data(0, Qt::UserRole).toInt());
+}
@@ -0,0 +1,37 @@
+#ifndef QDKUSAGEDIALOG_H
+#define QDKUSAGEDIALOG_H
+
+#include <QDialog>
+
+class QDKEdit;
+class QComboBox;
+class QLabel;
+class QLineEdit;
+class QTreeWidget;
+class QTreeWidgetItem;
+
+// lists the levels and positions using a tile or sprite id
+class QDKUsageDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    explicit QDKUsageDialog(QDKEdit *edit, QWidget *parent = 0);
+
+signals:
+    void levelSelected(int id);
+
+public slots:
+    void search();
+
+private slots:
+    void openLevel(QTreeWidgetItem *item);
+
+private:
+    QDKEdit *edit;
+    QComboBox *cmbKind;
+    QLineEdit *txtID;
+    QLabel *lblResult;
+    QTreeWidget *tree;
+};
+
+#endif // QDKUSAGEDIALOG_H
@@ -10,13 +10,19 @@
 #include "QTileSelector.h"
 
 QTileEdit::QTileEdit(QWidget *parent) :
-    QWidget(parent), dataIsChanged(false), mousePressed(false), emptyTile(0), tileToDraw(emptyTile), keepAspect(true), selector(NULL), tileDataIs16bit(false), spriteMode(false), spriteContext(false), spriteToMove(-1)
+    QWidget(parent), dataIsChanged(false), mousePressed(false), emptyTile(0), tileToDraw(emptyTile), keepAspect(true), selector(NULL), tileDataIs16bit(false), spriteMode(false), spriteContext(false), spriteToMove(-1),
+    undoSaved(0), undoBytes(0), undoLimit(UNDO_MEMORY_LIMIT), tool(TOOL_PEN), toolTile(0)
 {
     //setMouseTracking(true);
     background = QImage(levelDimension.width()*tileSize.width(), levelDimension.height()*tileSize.height(), QImage::Format_ARGB32);
     background.fill(Qt::white);
     originalSize = QImage(0, 0, QImage::Format_RGB32);
-    connect(this, SIGNAL(dataChanged()), this, SLOT(keepUndoData()));
+}
+
+QTileEdit::~QTileEdit()
+{
+    qDeleteAll(undoSteps);
+    qDeleteAll(redoSteps);
 }
 
 void QTileEdit::getMouse(bool enable)
@@ -65,15 +71,33 @@ void QTileEdit::setTileToDraw(int tileNumber)
     tileToDraw = tileNumber;
 }
 
+void QTileEdit::setTool(int newTool)
+{
+    tool = newTool;
+
+    if (!toolCells.isEmpty())
+    {
+        toolCells.clear();
+        update();
+    }
+}
+
 bool QTileEdit::loadTileSet(QString filename, int emptyTileNumber, int count)
 {
-    if (!tileSet.load(filename))
+    QPixmap tilePixmap;
+    if (!tilePixmap.load(filename))
         return false;
 
+    setTileSet(tilePixmap, emptyTileNumber, count);
+    return true;
+}
+
+void QTileEdit::setTileSet(QPixmap tilePixmap, int emptyTileNumber, int count)
+{
+    tileSet = tilePixmap;
     emptyTile = emptyTileNumber;
     tileCount = count;
     tileSetDimension = QSize(tileSet.width() / tileSize.width(), tileSet.height() / tileSize.height());
-    return true;
 }
 
 void QTileEdit::setLevelData(QByteArray data, int start = 0, int length = 0)
@@ -143,6 +167,172 @@ void QTileEdit::setTile(int offset, int tileNumber)
     }
 }
 
+// rectangle drawn around the tile under the mouse
+QRect QTileEdit::hoverRect(int x, int y)
+{
+    return QRect(x * tileSize.width(), y * tileSize.height(), tileSize.width()-1, tileSize.height()-1);
+}
+
+QPoint QTileEdit::cellAt(const QPoint &pos)
+{
+    int x = (float)pos.x() / (float)tileSize.width() / scaleFactorX;
+    int y = (float)pos.y() / (float)tileSize.height() / scaleFactorY;
+
+    return QPoint(qBound(0, x, levelDimension.width()-1), qBound(0, y, levelDimension.height()-1));
+}
+
+QVector<QPoint> QTileEdit::lineCells(QPoint from, QPoint to, QSize footprint)
+{
+    QVector<QPoint> cells;
+
+    // bresenham, super tiles are only placed where they don't overlap the last one
+    int dx = qAbs(to.x() - from.x());
+    int dy = -qAbs(to.y() - from.y());
+    int sx = (from.x() < to.x()) ? 1 : -1;
+    int sy = (from.y() < to.y()) ? 1 : -1;
+    int err = dx + dy;
+    int x = from.x();
+    int y = from.y();
+
+    while (true)
+    {
+        if (cells.isEmpty() || (qAbs(x - cells.last().x()) >= footprint.width()) || (qAbs(y - cells.last().y()) >= footprint.height()))
+            cells.append(QPoint(x, y));
+
+        if ((x == to.x()) && (y == to.y()))
+            break;
+
+        int e2 = 2 * err;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y += sy;
+        }
+    }
+
+    return cells;
+}
+
+QVector<QPoint> QTileEdit::rectCells(QPoint from, QPoint to, QSize footprint)
+{
+    QVector<QPoint> cells;
+    QRect area = QRect(from, to).normalized();
+
+    // super tiles are tiled from the top left corner, at least one gets placed
+    for (int y = area.top(); (y == area.top()) || (y + footprint.height() - 1 <= area.bottom()); y += footprint.height())
+        for (int x = area.left(); (x == area.left()) || (x + footprint.width() - 1 <= area.right()); x += footprint.width())
+            cells.append(QPoint(x, y));
+
+    return cells;
+}
+
+QVector<QPoint> QTileEdit::fillCells(QPoint start, int tileNumber, QSize footprint)
+{
+    QVector<QPoint> cells;
+    int width = levelDimension.width();
+    int height = levelDimension.height();
+    int target = getTile(start.x(), start.y());
+
+    if ((target == -1) || ((target == tileNumber) && (footprint == QSize(1, 1))))
+        return cells;
+
+    // every cell of the connected area is visited once
+    QVector<bool> inside(width * height, false);
+    QVector<QPoint> stack;
+    QPoint p;
+
+    inside[start.y() * width + start.x()] = true;
+    stack.append(start);
+
+    while (!stack.isEmpty())
+    {
+        p = stack.last();
+        stack.pop_back();
+        cells.append(p);
+
+        QPoint next[4] = { QPoint(p.x()-1, p.y()), QPoint(p.x()+1, p.y()), QPoint(p.x(), p.y()-1), QPoint(p.x(), p.y()+1) };
+        for (int i = 0; i < 4; i++)
+        {
+            if ((next[i].x() < 0) || (next[i].y() < 0) || (next[i].x() >= width) || (next[i].y() >= height))
+                continue;
+
+            int n = next[i].y() * width + next[i].x();
+            if (!inside.at(n) && (getTile(n) == target))
+            {
+                inside[n] = true;
+                stack.append(next[i]);
+            }
+        }
+    }
+
+    if (footprint == QSize(1, 1))
+        return cells;
+
+    // super tiles go on a grid aligned to the start cell and have to fit into the area
+    QVector<QPoint> anchors;
+    for (int i = 0; i < cells.size(); i++)
+    {
+        p = cells.at(i);
+        if ((((p.x() - start.x()) % footprint.width()) != 0) || (((p.y() - start.y()) % footprint.height()) != 0))
+            continue;
+
+        bool fits = (p.x() + footprint.width() <= width) && (p.y() + footprint.height() <= height);
+        for (int y = 0; fits && (y < footprint.height()); y++)
+            for (int x = 0; fits && (x < footprint.width()); x++)
+                fits = inside.at((p.y() + y) * width + p.x() + x);
+
+        if (fits)
+            anchors.append(p);
+    }
+
+    return anchors;
+}
+
+bool QTileEdit::drawTiles(const QVector<QPoint> &cells, int tileNumber)
+{
+    QSize footprint = tileFootprint(tileNumber);
+    QRect dirty;
+
+    for (int i = 0; i < cells.size(); i++)
+    {
+        int x = cells.at(i).x();
+        int y = cells.at(i).y();
+
+        if ((getTile(x, y) == tileNumber) && (footprint == QSize(1, 1)))
+            continue;
+
+        // super tiles must not reach past the level border
+        if ((x + footprint.width() > levelDimension.width()) || (y + footprint.height() > levelDimension.height()))
+            continue;
+
+        setTile(x, y, tileNumber);
+        expandTile(x, y, tileNumber);
+        dirty |= QRect(x, y, footprint.width(), footprint.height());
+    }
+
+    if (dirty.isNull())
+        return false;
+
+    // the whole batch is one change, one undo step once the mouse is released
+    dataIsChanged = true;
+    emit dataChanged(QTileChange(CHANGE_CELLS, dirty));
+
+    if (keepAspect)
+    {
+        QRectF area(dirty.x() * tileSize.width() * scaleFactorX, dirty.y() * tileSize.height() * scaleFactorY,
+                    dirty.width() * tileSize.width() * scaleFactorX, dirty.height() * tileSize.height() * scaleFactorY);
+        update(area.toAlignedRect());
+    }
+    else
+        update();
+
+    return true;
+}
 
 QString QTileEdit::spriteNumToString(int sprite)
 {
@@ -272,6 +462,23 @@ void QTileEdit::paintLevel(QPainter *painter)
     painter->setPen(Qt::gray);
     painter->drawRect(mouseOverTile.x(), mouseOverTile.y(), mouseOverTile.width(), mouseOverTile.height());
 
+    //draw tool preview
+    if (!toolCells.isEmpty())
+    {
+        QSize footprint = tileFootprint(toolTile);
+
+        painter->setPen(Qt::darkYellow);
+        for (int i = 0; i < toolCells.size(); i++)
+            painter->drawRect(toolCells.at(i).x()*tileSize.width(), toolCells.at(i).y()*tileSize.height(), footprint.width()*tileSize.width()-1, footprint.height()*tileSize.height()-1);
+    }
+
+    //draw cell selection
+    if ((tool == TOOL_SELECT) && !selection.isNull())
+    {
+        painter->setPen(QPen(Qt::cyan, 1, Qt::DashLine));
+        painter->drawRect(selection.x()*tileSize.width(), selection.y()*tileSize.height(), selection.width()*tileSize.width()-1, selection.height()*tileSize.height()-1);
+    }
+
     //draw sprite selection
     if (spriteMode)
     {
@@ -336,7 +543,7 @@ void QTileEdit::mouseMoveEvent(QMouseEvent *e)
 
         setToolTip(QString("%1 (%2x%3)").arg(tileNumToString(getTile(xTile, yTile))).arg(xTile).arg(yTile));
 
-        QRect newSelection(xTile * tileSize.width(), yTile * tileSize.height(), tileSize.width()-1, tileSize.height()-1);
+        QRect newSelection = hoverRect(xTile, yTile);
 
         if (mouseOverTile != newSelection)
         {
@@ -348,6 +555,38 @@ void QTileEdit::mouseMoveEvent(QMouseEvent *e)
         if ((e->buttons() != Qt::LeftButton) && (e->buttons() != Qt::RightButton))
             return;
 
+        // line and rectangle are only previewed until the button is released
+        if (tool != TOOL_PEN)
+        {
+            if (!mousePressed || (tool == TOOL_FILL))
+                return;
+
+            QPoint end = cellAt(e->pos());
+            QVector<QPoint> cells;
+
+            if (tool == TOOL_SELECT)
+            {
+                if (QRect(toolStart, end).normalized() != selection)
+                {
+                    selection = QRect(toolStart, end).normalized();
+                    update();
+                }
+                return;
+            }
+
+            if (tool == TOOL_LINE)
+                cells = lineCells(toolStart, end, tileFootprint(toolTile));
+            else
+                cells = rectCells(toolStart, end, tileFootprint(toolTile));
+
+            if (cells != toolCells)
+            {
+                toolCells = cells;
+                update();
+            }
+            return;
+        }
+
         int tmpTileToDraw = tileToDraw;
 
         //always draw emptyTile for right click
@@ -359,7 +598,7 @@ void QTileEdit::mouseMoveEvent(QMouseEvent *e)
         {
             setTile(xTile, yTile, tmpTileToDraw);
             dataIsChanged = true;
-            emit dataChanged();
+            emit dataChanged(QTileChange(CHANGE_CELLS, QRect(QPoint(xTile, yTile), tileFootprint(tmpTileToDraw))));
             emit singleTileChanged(xTile, yTile, tmpTileToDraw);
             update();
         }
@@ -434,7 +673,7 @@ void QTileEdit::mouseMoveEvent(QMouseEvent *e)
             spriteSelection = spriteRect;
             dataIsChanged = true;
 
-            emit dataChanged();
+            emit dataChanged(QTileChange(CHANGE_SPRITES, QRect(), spriteToMove));
             update();
         }
     }
@@ -448,7 +687,32 @@ void QTileEdit::mousePressEvent(QMouseEvent *e)
         mousePressed = true;
     }
 
-    if (!spriteMode)
+    if (!spriteMode && (tool != TOOL_PEN))
+    {
+        if ((e->button() != Qt::LeftButton) && (e->button() != Qt::RightButton))
+            return;
+
+        if ((e->x()+1 > scaledSize.width()) || (e->x() < 0) || (e->y()+1 > scaledSize.height()) || (e->y() < 0))
+            return;
+
+        //always draw emptyTile for right click
+        toolTile = (e->button() == Qt::RightButton) ? emptyTile : tileToDraw;
+        toolStart = cellAt(e->pos());
+
+        if (tool == TOOL_SELECT)
+        {
+            selection = QRect(toolStart, toolStart);
+            update();
+        }
+        else if (tool == TOOL_FILL)
+            drawTiles(fillCells(toolStart, toolTile, tileFootprint(toolTile)), toolTile);
+        else
+        {
+            toolCells = QVector<QPoint>() << toolStart;
+            update();
+        }
+    }
+    else if (!spriteMode)
         mouseMoveEvent(e);
     else
     {
@@ -474,7 +738,7 @@ void QTileEdit::mousePressEvent(QMouseEvent *e)
                 dataIsChanged = true;
                 emit spriteSelected(-1);
                 emit spriteRemoved(spriteToMove);
-                emit dataChanged();
+                emit dataChanged(QTileChange(CHANGE_SPRITES, QRect(), spriteToMove));
                 spriteToMove = -1;
                 selectedSprite = -1;
                 update();
@@ -550,8 +814,18 @@ void QTileEdit::mouseReleaseEvent(QMouseEvent *)
 {
     mousePressed = false;
 
-    if (!keepUndo)
-        deleteLastUndo();
+    if (!toolCells.isEmpty())
+    {
+        QVector<QPoint> cells = toolCells;
+        toolCells.clear();
+
+        // without changes the preview still has to go
+        if (!drawTiles(cells, toolTile))
+            update();
+    }
+
+    // steps without changes are dropped
+    commitUndoStep();
 }
 
 int QTileEdit::getSelectedSprite(int *id)
@@ -661,7 +935,7 @@ void QTileEdit::deleteSprite(int num)
     dataIsChanged = true;
     emit spriteSelected(-1);
     emit spriteRemoved(num);
-    emit dataChanged();
+    emit dataChanged(QTileChange(CHANGE_SPRITES, QRect(), num));
     spriteToMove = -1;
     selectedSprite = -1;
     update();
@@ -686,81 +960,386 @@ void QTileEdit::setSpriteFlag(int num, quint8 flag)
     emit flagByteChanged(num);
 }
 
-void QTileEdit::keepUndoData()
+bool QTileEditStep::isEmpty() const
 {
-    keepUndo = true;
+    return cells.isEmpty() && oldData.isEmpty() && newData.isEmpty() && oldSprites.isEmpty() && newSprites.isEmpty();
 }
 
-void QTileEdit::createUndoData()
+int QTileEditStep::changes() const
 {
-    QByteArray undoBytes;
-    QVector<QSprite> undoSprites;
+    int what = 0;
 
-    keepUndo = false;
+    if (!cells.isEmpty() || !oldData.isEmpty() || !newData.isEmpty())
+        what |= CHANGE_CELLS;
+    if (!oldSprites.isEmpty() || !newSprites.isEmpty())
+        what |= CHANGE_SPRITES;
+
+    return what;
+}
 
-    undoBytes.clear();
-    undoBytes.append(lvlData);
+qint64 QTileEditStep::bytes() const
+{
+    return sizeof(*this) + cells.size() * sizeof(QTileEditCell) + oldData.size() + newData.size()
+            + (oldSprites.size() + newSprites.size()) * sizeof(QSprite);
+}
 
+static void writeSprites(QDataStream *out, const QVector<QSprite> &sprites)
+{
+    *out << (quint32)sprites.size();
     for (int i = 0; i < sprites.size(); i++)
-        undoSprites.append(sprites.at(i));
+    {
+        const QSprite &sprite = sprites.at(i);
+        *out << sprite.pixelPerfect << (qint32)sprite.x << (qint32)sprite.y << sprite.size << sprite.drawOffset;
+        *out << (qint32)sprite.rotate << (qint32)sprite.id << sprite.flagByte;
+    }
+}
 
-    undoStack.push(qMakePair(undoBytes, undoSprites));
+static void readSprites(QDataStream *in, QVector<QSprite> *sprites)
+{
+    quint32 count;
+    qint32 x, y, rotate, id;
+
+    *in >> count;
+    sprites->resize(count);
+    for (quint32 i = 0; i < count; i++)
+    {
+        QSprite &sprite = (*sprites)[i];
+        *in >> sprite.pixelPerfect >> x >> y >> sprite.size >> sprite.drawOffset >> rotate >> id >> sprite.flagByte;
+        sprite.x = x;
+        sprite.y = y;
+        sprite.rotate = rotate;
+        sprite.id = id;
+        sprite.sprite = NULL;
+    }
 }
 
-void QTileEdit::undo()
+void QTileEditStep::write(QDataStream *out) const
+{
+    *out << (quint32)cells.size();
+    for (int i = 0; i < cells.size(); i++)
+        *out << cells.at(i).offset << cells.at(i).oldValue << cells.at(i).newValue;
+
+    *out << oldData << newData << (qint32)spriteIndex;
+    writeSprites(out, oldSprites);
+    writeSprites(out, newSprites);
+}
+
+void QTileEditStep::read(QDataStream *in)
+{
+    quint32 count;
+    qint32 index;
+
+    *in >> count;
+    cells.resize(count);
+    for (quint32 i = 0; i < count; i++)
+        *in >> cells[i].offset >> cells[i].oldValue >> cells[i].newValue;
+
+    *in >> oldData >> newData >> index;
+    spriteIndex = index;
+    readSprites(in, &oldSprites);
+    readSprites(in, &newSprites);
+}
+
+static bool sameSprite(const QSprite &a, const QSprite &b)
+{
+    // the pixmap pointer changes with every tileset update
+    return (a.id == b.id) && (a.x == b.x) && (a.y == b.y) && (a.flagByte == b.flagByte) && (a.rotate == b.rotate)
+            && (a.pixelPerfect == b.pixelPerfect) && (a.size == b.size) && (a.drawOffset == b.drawOffset);
+}
+
+void QTileEdit::setUndoLimit(qint64 bytes)
+{
+    undoLimit = bytes;
+    limitUndoData();
+}
+
+qint64 QTileEdit::undoMemory() const
+{
+    return undoBytes;
+}
+
+void QTileEdit::createUndoData()
+{
+    // everything changed since the last commit becomes its own step
+    commitUndoStep();
+}
+
+void QTileEdit::commitUndoStep()
+{
+    QTileEditStep *step = newUndoStep();
+    diffUndoStep(step);
+
+    if (step->isEmpty())
+        delete step;
+    else
+    {
+        // a new edit ends the redo history
+        for (int i = 0; i < redoSteps.size(); i++)
+            undoBytes -= redoSteps.at(i)->bytes();
+        qDeleteAll(redoSteps);
+        redoSteps.clear();
+
+        if (undoSaved > undoSteps.size())
+            undoSaved = -1;
+
+        undoSteps.append(step);
+        undoBytes += step->bytes();
+        journalUndoStep(step, false);
+        limitUndoData();
+    }
+
+    rebaseUndoData();
+}
+
+void QTileEdit::markUndoSaved()
 {
-    if (undoStack.isEmpty())
+    commitUndoStep();
+    undoSaved = undoSteps.size();
+}
+
+void QTileEdit::rewindUndoToSaved()
+{
+    // only the history is moved, the caller restores the saved data itself
+    commitUndoStep();
+
+    if (undoSaved < 0)
+    {
+        clearUndoData();
         return;
+    }
 
-    QVector<QSprite> undoSprites;
-    QPair<QByteArray, QVector<QSprite> > undoData;
+    while (undoSteps.size() > undoSaved)
+    {
+        redoSteps.append(undoSteps.takeLast());
+        journalUndoStep(redoSteps.last(), true);
+    }
 
-    spriteToMove = -1;
+    while ((undoSteps.size() < undoSaved) && !redoSteps.isEmpty())
+    {
+        undoSteps.append(redoSteps.takeLast());
+        journalUndoStep(undoSteps.last(), false);
+    }
+}
 
-    undoData = undoStack.pop();
+QByteArray QTileEdit::takeUndoHistory()
+{
+    commitUndoStep();
 
-    lvlData.clear();
-    lvlData.append(undoData.first);
+    QByteArray history;
+    if (undoSteps.isEmpty() && redoSteps.isEmpty())
+        return history;
 
-    for (int i = sprites.size()-1; i >= 0; i--)
-        emit spriteRemoved(i);
+    QDataStream out(&history, QIODevice::WriteOnly);
+    out << (qint32)undoSaved;
 
-    sprites.clear();
+    out << (quint32)undoSteps.size();
+    for (int i = 0; i < undoSteps.size(); i++)
+        undoSteps.at(i)->write(&out);
 
-    undoSprites = undoData.second;
-    for (int i = 0; i < undoSprites.size(); i++)
+    out << (quint32)redoSteps.size();
+    for (int i = 0; i < redoSteps.size(); i++)
+        redoSteps.at(i)->write(&out);
+
+    clearUndoData();
+
+    return history;
+}
+
+void QTileEdit::restoreUndoHistory(const QByteArray &history)
+{
+    clearUndoData();
+
+    if (history.isEmpty())
+        return;
+
+    QDataStream in(history);
+    QTileEditStep *step;
+    qint32 saved;
+    quint32 count;
+
+    in >> saved;
+
+    in >> count;
+    for (quint32 i = 0; i < count; i++)
     {
-        sprites.append(undoSprites.at(i));
-        emit spriteAdded(spriteNumToString(undoSprites.at(i).id), undoSprites.at(i).id);
+        step = newUndoStep();
+        step->read(&in);
+        undoSteps.append(step);
+        undoBytes += step->bytes();
     }
-    undoSprites.clear();
 
-    spriteSelection = QRect();
+    in >> count;
+    for (quint32 i = 0; i < count; i++)
+    {
+        step = newUndoStep();
+        step->read(&in);
+        redoSteps.append(step);
+        undoBytes += step->bytes();
+    }
 
-    update();
+    undoSaved = saved;
+
+    if (in.status() != QDataStream::Ok)
+    {
+        qWarning() << "Undo history is corrupted and got dropped";
+        clearUndoData();
+    }
 }
 
-void QTileEdit::clearUndoData()
+void QTileEdit::rebaseUndoData()
 {
-    QPair<QByteArray, QVector<QSprite> > undoData;
+    // implicitly shared - the copy is only made once the data gets changed,
+    // so every stroke pays one copy of the level data and one of the sprites
+    undoBaseData = lvlData;
+    undoBaseSprites = sprites;
+}
+
+QTileEditStep *QTileEdit::newUndoStep() const
+{
+    return new QTileEditStep();
+}
 
-    while (!undoStack.isEmpty())
+// snapshot and diff instead of recording in every mutator: the level data, the
+// sprites and the switches get written in many places (tools, paste, size changes)
+void QTileEdit::diffUndoStep(QTileEditStep *step)
+{
+    // still shared with the base -> unchanged
+    if (lvlData.constData() != undoBaseData.constData())
     {
-        undoData = undoStack.pop();
-        undoData.first.clear();
-        undoData.second.clear();
+        if (lvlData.size() != undoBaseData.size())
+        {
+            step->oldData = undoBaseData;
+            step->newData = lvlData;
+        }
+        else
+        {
+            const char *before = undoBaseData.constData();
+            const char *after = lvlData.constData();
+
+            for (int i = 0; i < lvlData.size(); i++)
+                if (before[i] != after[i])
+                {
+                    QTileEditCell cell;
+                    cell.offset = i;
+                    cell.oldValue = before[i];
+                    cell.newValue = after[i];
+                    step->cells.append(cell);
+                }
+        }
     }
+
+    if (sprites.constData() != undoBaseSprites.constData())
+        diffItems(undoBaseSprites, sprites, sameSprite, &step->spriteIndex, &step->oldSprites, &step->newSprites);
+}
+
+void QTileEdit::applyUndoStep(QTileEditStep *step, bool undo)
+{
+    if (!step->oldData.isEmpty() || !step->newData.isEmpty())
+        lvlData = undo ? step->oldData : step->newData;
+
+    for (int i = 0; i < step->cells.size(); i++)
+        if (step->cells.at(i).offset < lvlData.size())
+            lvlData[step->cells.at(i).offset] = undo ? step->cells.at(i).oldValue : step->cells.at(i).newValue;
+
+    if (step->oldSprites.isEmpty() && step->newSprites.isEmpty())
+        return;
+
+    // the sprite list only supports appending
+    for (int i = sprites.size()-1; i >= 0; i--)
+        emit spriteRemoved(i);
+
+    if (undo)
+        replaceItems(&sprites, step->spriteIndex, step->newSprites.size(), step->oldSprites);
+    else
+        replaceItems(&sprites, step->spriteIndex, step->oldSprites.size(), step->newSprites);
+
+    for (int i = 0; i < sprites.size(); i++)
+        emit spriteAdded(spriteNumToString(sprites.at(i).id), sprites.at(i).id);
 }
 
-void QTileEdit::deleteLastUndo()
+void QTileEdit::limitUndoData()
 {
-    if (!undoStack.isEmpty())
+    QTileEditStep *step;
+
+    // the oldest undo steps go first, then the furthest redo steps
+    while ((undoBytes > undoLimit) && !undoSteps.isEmpty())
+    {
+        step = undoSteps.takeFirst();
+        undoBytes -= step->bytes();
+        delete step;
+        undoSaved--;
+    }
+
+    while ((undoBytes > undoLimit) && !redoSteps.isEmpty())
     {
-        QPair<QByteArray, QVector<QSprite> > undoData = undoStack.pop();
-        undoData.first.clear();
-        undoData.second.clear();
+        step = redoSteps.takeFirst();
+        undoBytes -= step->bytes();
+        delete step;
     }
+
+    if (undoSaved > undoSteps.size() + redoSteps.size())
+        undoSaved = -1;
 }
+
+void QTileEdit::undo()
+{
+    commitUndoStep();
+
+    if (undoSteps.isEmpty())
+        return;
+
+    spriteToMove = -1;
+
+    QTileEditStep *step = undoSteps.takeLast();
+    applyUndoStep(step, true);
+    redoSteps.append(step);
+    journalUndoStep(step, true);
+
+    rebaseUndoData();
+
+    spriteSelection = QRect();
+    dataIsChanged = true;
+
+    emit dataChanged(QTileChange(step->changes()));
+    update();
+}
+
+void QTileEdit::redo()
+{
+    // also drops the redo steps if something got changed in the meantime
+    commitUndoStep();
+
+    if (redoSteps.isEmpty())
+        return;
+
+    spriteToMove = -1;
+
+    QTileEditStep *step = redoSteps.takeLast();
+    applyUndoStep(step, false);
+    undoSteps.append(step);
+    journalUndoStep(step, false);
+
+    rebaseUndoData();
+
+    spriteSelection = QRect();
+    dataIsChanged = true;
+
+    emit dataChanged(QTileChange(step->changes()));
+    update();
+}
+
+void QTileEdit::clearUndoData()
+{
+    qDeleteAll(undoSteps);
+    qDeleteAll(redoSteps);
+    undoSteps.clear();
+    redoSteps.clear();
+    undoSaved = 0;
+    undoBytes = 0;
+
+    rebaseUndoData();
+}
+
 void QTileEdit::clearLevel()
 {
     createUndoData();
@@ -784,7 +1363,7 @@ void QTileEdit::clearLevel()
     spriteToMove = -1;
 
     dataIsChanged = true;
-    emit dataChanged();
+    emit dataChanged(QTileChange(CHANGE_CELLS | CHANGE_SPRITES));
 
     update();
 }
@@ -2,33 +2,101 @@
 #define QTILEEDIT_H
 
 #include <QWidget>
+#include <QDataStream>
 #include <QMap>
 #include <QStack>
 
+#include "QSprite.h"
+
+// default cap of the undo log in bytes, the oldest steps are dropped first
+#define UNDO_MEMORY_LIMIT (256 * 1024)
+
+// drawing tools, everything but the pen is applied as one batch
+// select only marks a rectangle of cells
+enum { TOOL_PEN = 0, TOOL_LINE = 1, TOOL_RECT = 2, TOOL_FILL = 3, TOOL_SELECT = 4 };
+
+// what an edit touched, sent with dataChanged
+// LEVEL: another level got loaded or the stored level was written
+enum { CHANGE_CELLS = 0x01, CHANGE_SPRITES = 0x02, CHANGE_SWITCHES = 0x04, CHANGE_PROPERTIES = 0x08,
+       CHANGE_EDIT = 0x0F, CHANGE_LEVEL = 0x10, CHANGE_ALL = 0x1F };
+
+struct QTileChange
+{
+    QTileChange(int what = CHANGE_ALL, const QRect &cells = QRect(), int index = -1) : what(what), cells(cells), index(index) {}
+
+    int what;
+    QRect cells; // cells drawn to (super tiles erased on the way may reach past it), null if unknown
+    int index; // changed sprite or switch, -1 if unknown or several
+};
+
 class QTileSelector;
 
-enum { BOTTOM = 0, FLIPPED = 1, TOP = 2, LEFT = 3, RIGHT = 4 };
+// changed byte of the level data
+struct QTileEditCell
+{
+    quint16 offset;
+    quint8 oldValue;
+    quint8 newValue;
+};
 
-struct QSprite
+// one undo step holds only what changed between two commits
+// subclasses extend it with their own data
+struct QTileEditStep
 {
-    bool pixelPerfect;
-    int x, y;
-    QSize size;
-    QPointF drawOffset;
-    QPixmap *sprite;
-    int rotate;
-    int id;
-    quint8 flagByte;    
+    QTileEditStep() : spriteIndex(0) {}
+    virtual ~QTileEditStep() {}
+    virtual bool isEmpty() const;
+    virtual qint64 bytes() const;
+    virtual void write(QDataStream *out) const;
+    virtual void read(QDataStream *in);
+    virtual int changes() const; // CHANGE_* flags of what the step touches
+
+    QVector<QTileEditCell> cells;
+    QByteArray oldData, newData; // whole level data, only if its size changed
+    int spriteIndex; // oldSprites got replaced by newSprites at this index
+    QVector<QSprite> oldSprites;
+    QVector<QSprite> newSprites;
 };
 
+// smallest range of items that differs between two lists
+template <typename T, typename List>
+void diffItems(const List &before, const List &after, bool (*same)(const T &, const T &), int *index, List *removed, List *inserted)
+{
+    int start = 0;
+    int endBefore = before.size();
+    int endAfter = after.size();
+
+    while ((start < endBefore) && (start < endAfter) && same(before.at(start), after.at(start)))
+        start++;
+
+    while ((endBefore > start) && (endAfter > start) && same(before.at(endBefore - 1), after.at(endAfter - 1)))
+    {
+        endBefore--;
+        endAfter--;
+    }
+
+    *index = start;
+    *removed = before.mid(start, endBefore - start);
+    *inserted = after.mid(start, endAfter - start);
+}
+
+// replaces count items at index
+template <typename List>
+void replaceItems(List *list, int index, int count, const List &items)
+{
+    *list = list->mid(0, index) + items + list->mid(index + count);
+}
+
 class QTileEdit : public QWidget
 {
     Q_OBJECT
 public:
     explicit QTileEdit(QWidget *parent = 0);
+    ~QTileEdit();
 
     bool isChanged();
     bool loadTileSet(QString filename, int emptyTileNumber, int count);
+    void setTileSet(QPixmap tilePixmap, int emptyTileNumber, int count);
 
     void setLevelDimension(int width, int height);
     void setTileSize(int width, int height);
@@ -43,6 +111,11 @@ public:
 
     void setupTileSelector(QTileSelector *tileSelector, float scale = 1.25f, int limitTileCount = 0);
 
+    void setUndoLimit(qint64 bytes);
+    qint64 undoMemory() const;
+    QByteArray takeUndoHistory();
+    void restoreUndoHistory(const QByteArray &history);
+
 protected:
     void paintEvent(QPaintEvent *e);
     virtual void paintLevel(QPainter *painter);
@@ -61,16 +134,42 @@ protected:
     int getTile(int x, int y);
     int getTile(int offset);
     void setTile(int x, int y, int tileNumber);
-    void setTile(int offset, int tileNumber);
+    virtual void setTile(int offset, int tileNumber);
+    virtual QRect hoverRect(int x, int y);
+
+    // cells get painted with drawTiles, super tiles are placed on their top left cell
+    QPoint cellAt(const QPoint &pos);
+    QVector<QPoint> lineCells(QPoint from, QPoint to, QSize footprint);
+    QVector<QPoint> rectCells(QPoint from, QPoint to, QSize footprint);
+    QVector<QPoint> fillCells(QPoint start, int tileNumber, QSize footprint);
+    bool drawTiles(const QVector<QPoint> &cells, int tileNumber);
+    virtual QSize tileFootprint(int) { return QSize(1, 1); }
+    virtual void expandTile(int, int, int) {}
 
     QMap<int, QString> spriteNames;
     QMap<int, QString> tileNames;
 
-    QStack<QPair<QByteArray, QVector<QSprite> > > undoStack;
-    bool keepUndo;
-    virtual void createUndoData();
+    // the undo log stores the differences to the state of the last commit
+    // the first edit after a commit detaches the base, i.e. copies the level data
+    // (0x700 bytes for a big level) and the sprite vector, a commit scans all of it
+    QList<QTileEditStep *> undoSteps;
+    QList<QTileEditStep *> redoSteps; // the last one is redone first
+    int undoSaved; // undo steps up to the saved state, -1 if it can't be reached
+    QByteArray undoBaseData;
+    QVector<QSprite> undoBaseSprites;
+    qint64 undoBytes;
+    qint64 undoLimit;
+    void createUndoData();
+    void commitUndoStep();
+    void markUndoSaved();
+    void rewindUndoToSaved();
     virtual void clearUndoData();
-    virtual void deleteLastUndo();
+    virtual void rebaseUndoData();
+    virtual QTileEditStep *newUndoStep() const;
+    virtual void diffUndoStep(QTileEditStep *step);
+    virtual void applyUndoStep(QTileEditStep *step, bool undo);
+    virtual void journalUndoStep(const QTileEditStep *, bool) {}
+    void limitUndoData();
 
     QVector<QSprite> sprites;
     QByteArray lvlData;
@@ -82,6 +181,11 @@ protected:
     int spriteToMove;
     int selectedSprite;
     int mousePressed;
+    int tool;
+    int toolTile; // tile of the running line or rectangle
+    QPoint toolStart;
+    QVector<QPoint> toolCells; // preview of the running line or rectangle
+    QRect selection; // cells marked with the select tool
     float scaleFactorX;
     float scaleFactorY;
     bool dataIsChanged;
@@ -103,7 +207,7 @@ protected:
     QTileSelector *selector;
 
 signals:
-    void dataChanged();
+    void dataChanged(const QTileChange &change);
     void singleTileChanged(int x, int y, int drawnTile);
     void spriteSelected(int spriteNo);
     void spriteAdded(QString text, int id);
@@ -112,15 +216,16 @@ signals:
 
 public slots:
     void updateLevel();
-    void keepUndoData();
     virtual void clearLevel();
     void setTileToDraw(int tileNumber);
+    void setTool(int newTool);
     void toggleSpriteMode(bool enabled);
     void toggleSpriteMode(int enabled);
     void getSpriteFlag(int num, quint8 *flag);
     void setSpriteFlag(int num, quint8 flag);
     void deleteSprite(int num);
     virtual void undo();
+    virtual void redo();
 };
 
 #endif // QTILEEDIT_H
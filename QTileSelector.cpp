@@ -18,10 +18,22 @@ QTileSelector::QTileSelector(QWidget *parent) :
     //setMouseTracking(true);
 }
 
-void QTileSelector::changeTilePixmap(QPixmap tilePixmap)
+void QTileSelector::changeTilePixmap(QPixmap tilePixmap, QImage *arrangedCache)
 {
     tiles = tilePixmap;
+
+    // reuse the arranged tiles if they were built for the current size
+    if (arrangedCache && (arrangedCache->size() == this->rect().size()))
+    {
+        arrangedTiles = *arrangedCache;
+        update();
+        return;
+    }
+
     updateImage();
+
+    if (arrangedCache)
+        *arrangedCache = arrangedTiles;
 }
 
 void QTileSelector::setTilePixmap(QPixmap tilePixmap, QSize size, float scale, int count, QStringList names)
@@ -64,7 +64,7 @@ signals:
 
 public slots:
     void setTilePixmap(QPixmap tilePixmap, QSize size, float scale, int count, QStringList names);
-    void changeTilePixmap(QPixmap tilePixmap);
+    void changeTilePixmap(QPixmap tilePixmap, QImage *arrangedCache = NULL);
     void groupTiles(QTileGroups grouping, QSpacings spacings);
     void setTilePixSrc(QDKEdit *src);
 };
@@ -0,0 +1,234 @@
+#include "QDKBenchmark.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QDataStream>
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtGui/QPixmap>
+
+QDKBenchmark::QDKBenchmark(QDKEdit *edit) :
+    edit(edit)
+{
+}
+
+bool QDKBenchmark::prepare(QString romFile)
+{
+    QFile rom(romFile);
+    if (!rom.open(QIODevice::ReadOnly))
+    {
+        qWarning() << QString("Could not open %1").arg(romFile);
+        return false;
+    }
+    romData = rom.readAll();
+    rom.close();
+
+    if (!edit->loadAllLevels(romFile))
+        return false;
+
+    edit->changeLevel(0);
+
+    // nothing may be built in the background while measuring
+    for (int id = 0; id < MAX_TILESETS; id++)
+        edit->waitForTileset(id);
+    for (int set = -1; set < MAX_TILESETS; set++)
+        edit->waitForSprites(set);
+
+    // raw and compressed tilemaps for the LZSS benchmarks
+    rawTilemaps.clear();
+    compressed.clear();
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        rawTilemaps.append(QDKRom::rawTilemap(edit->levels[i].tilemap));
+        compressed.append(edit->LZSSCompress(&rawTilemaps[i]));
+
+        QBuffer buffer(&compressed[i]);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
+        if (edit->LZSSDecompress(&in, rawTilemaps.at(i).size()) != rawTilemaps.at(i))
+            qWarning() << QString("Level %1: LZSS round trip differs!").arg(i);
+    }
+
+    return true;
+}
+
+qint64 QDKBenchmark::lzssCompress()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < LAST_LEVEL; i++)
+        edit->LZSSCompress(&rawTilemaps[i]);
+
+    return timer.nsecsElapsed();
+}
+
+qint64 QDKBenchmark::lzssDecompress()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        QBuffer buffer(&compressed[i]);
+        buffer.open(QIODevice::ReadOnly);
+        QDataStream in(&buffer);
+        edit->LZSSDecompress(&in, rawTilemaps.at(i).size());
+    }
+
+    return timer.nsecsElapsed();
+}
+
+qint64 QDKBenchmark::readLevels()
+{
+    QBuffer rom(&romData);
+    rom.open(QIODevice::ReadOnly);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < MAX_LEVEL_ID; i++)
+        edit->readLevel(&rom, i);
+
+    return timer.nsecsElapsed();
+}
+
+qint64 QDKBenchmark::recompressLevels()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        edit->levels[i].fullDataUpToDate = false;
+        edit->recompressLevel(i);
+    }
+
+    return timer.nsecsElapsed();
+}
+
+qint64 QDKBenchmark::saveAllLevels()
+{
+    // the levels are written into a copy of the rom in memory
+    QByteArray data = romData;
+    QBuffer rom(&data);
+    rom.open(QIODevice::ReadWrite);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!edit->writeAllLevels(&rom))
+        qWarning() << "saveAllLevels failed!";
+
+    qint64 ns = timer.nsecsElapsed();
+
+    // the level offsets now point into the saved rom
+    romData = data;
+
+    return ns;
+}
+
+qint64 QDKBenchmark::createTileSets()
+{
+    // decode all tilesets from scratch on a single thread
+    edit->baseTileset = QImage();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int id = 0; id < MAX_TILESETS; id++)
+        edit->buildTileset(id);
+
+    return timer.nsecsElapsed();
+}
+
+qint64 QDKBenchmark::updateTilesetUncached()
+{
+    int orgTileset = edit->currentTileset;
+    qint64 ns = 0;
+    QElapsedTimer timer;
+
+    for (int id = 0; id < MAX_TILESETS; id++)
+    {
+        // drop everything rendered so every tileset gets recoloured
+        delete edit->currentRender;
+        edit->currentRender = NULL;
+        edit->renderCache.clear();
+        edit->currentTileset = id;
+
+        timer.start();
+        edit->updateTileset();
+        ns += timer.nsecsElapsed();
+    }
+
+    edit->currentTileset = orgTileset;
+    edit->updateTileset();
+
+    return ns;
+}
+
+qint64 QDKBenchmark::updateTilesetCached()
+{
+    int orgTileset = edit->currentTileset;
+    int count = qMin(RENDER_CACHE_SIZE, MAX_TILESETS);
+
+    // these fit into the render cache
+    for (int id = 0; id < count; id++)
+    {
+        edit->currentTileset = id;
+        edit->updateTileset();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int id = 0; id < count; id++)
+    {
+        edit->currentTileset = id;
+        edit->updateTileset();
+    }
+
+    qint64 ns = timer.nsecsElapsed();
+
+    edit->currentTileset = orgTileset;
+    edit->updateTileset();
+
+    return ns;
+}
+
+qint64 QDKBenchmark::calcVRAMusage()
+{
+    int orgLevel = edit->currentLevel;
+    qint64 ns = 0;
+    QElapsedTimer timer;
+
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        edit->changeLevel(i);
+
+        timer.start();
+        edit->calcVRAMusage();
+        ns += timer.nsecsElapsed();
+    }
+
+    edit->changeLevel(orgLevel);
+
+    return ns;
+}
+
+qint64 QDKBenchmark::paintLevel(int zoom)
+{
+    QSize size = edit->orgSize * zoom;
+    edit->resize(size);
+    edit->resized(size);
+
+    QPixmap frame(size);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int i = 0; i < BENCH_FRAMES; i++)
+        edit->render(&frame);
+
+    return timer.nsecsElapsed() / BENCH_FRAMES;
+}
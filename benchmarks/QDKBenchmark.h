@@ -0,0 +1,38 @@
+#ifndef QDKBENCHMARK_H
+#define QDKBENCHMARK_H
+
+#include "QDKEdit.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+
+// number of frames painted per paintLevel round
+#define BENCH_FRAMES 10
+
+// every benchmark returns the time spent in the measured calls in ns
+// setup work in between is not counted
+class QDKBenchmark
+{
+public:
+    explicit QDKBenchmark(QDKEdit *edit);
+    bool prepare(QString romFile);
+
+    qint64 lzssCompress();
+    qint64 lzssDecompress();
+    qint64 readLevels();
+    qint64 recompressLevels();
+    qint64 saveAllLevels();
+    qint64 createTileSets();
+    qint64 updateTilesetUncached();
+    qint64 updateTilesetCached();
+    qint64 calcVRAMusage();
+    qint64 paintLevel(int zoom); // per frame
+
+private:
+    QDKEdit *edit;
+    QByteArray romData;
+    QList<QByteArray> rawTilemaps;
+    QList<QByteArray> compressed;
+};
+
+#endif // QDKBENCHMARK_H
@@ -0,0 +1,39 @@
+#-------------------------------------------------
+#
+# eDKit benchmarks
+# built together with the editor from eDKit.pro
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
+TARGET = eDKitBenchmarks
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += .. ../core
+DEPENDPATH += ../core
+
+SOURCES += main.cpp\
+        QDKBenchmark.cpp\
+        ../QTileEdit.cpp\
+        ../QTileSelector.cpp\
+        ../QDKEdit.cpp\
+        ../QDKAssetCache.cpp\
+        ../QDKJournal.cpp
+
+HEADERS  += QDKBenchmark.h\
+        ../QTileEdit.h\
+        ../QTileSelector.h\
+        ../QDKEdit.h\
+        ../QDKAssetCache.h\
+        ../QDKJournal.h
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../core/release/ -leDKitCore
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../core/debug/ -leDKitCore
+else:unix: LIBS += -L$$OUT_PWD/../core/ -leDKitCore
+
+unix: PRE_TARGETDEPS += $$OUT_PWD/../core/libeDKitCore.a
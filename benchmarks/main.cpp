@@ -0,0 +1,200 @@
+#include <QApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+#include <QtGui/QImage>
+
+#include "MainWindow.h"
+#include "QDKBenchmark.h"
+#include "QGBTileDecoder.h"
+
+// same amount of work as createTileSets: 0x22 tilesets with 704 tiles each
+#define BENCH_TILESETS 0x22
+#define BENCH_TILES 704
+#define BENCH_ROUNDS 5
+
+// the per pixel loop copyTileToSet and createSprites used before QGBTileDecoder
+static void decodeTileSetPixel(const uchar *src, QImage *img, int tileX, int tileY)
+{
+    quint8 low, high, pixel;
+
+    for (int i = 0; i < 8; i++)
+    {
+        low = *src++;
+        high = *src++;
+
+        for (int j = 0; j < 8; j++)
+        {
+            pixel = low & 0x80;
+            pixel >>= 1;
+            pixel |= high & 0x80;
+            pixel >>= 6;
+
+            low <<= 1;
+            high <<= 1;
+
+            img->setPixel(tileX+j, tileY+i, pixel);
+        }
+    }
+}
+
+static qint64 runTileDecode(const QByteArray &data, QImage *img, bool useTable)
+{
+    const uchar *src;
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int set = 0; set < BENCH_TILESETS; set++)
+    {
+        src = (const uchar *)data.constData();
+        for (int t = 0; t < BENCH_TILES; t++)
+        {
+            if (useTable)
+                decodeTileToImage(src, img, (t % 16) * 8, (t / 16) * 8);
+            else
+                decodeTileSetPixel(src, img, (t % 16) * 8, (t / 16) * 8);
+            src += GB_TILE_BYTES;
+        }
+    }
+
+    return timer.nsecsElapsed();
+}
+
+struct QDKBenchResult
+{
+    QString name;
+    int rounds;
+    qint64 best;
+    qint64 total;
+};
+
+typedef qint64 (QDKBenchmark::*QDKBenchFunc)();
+
+static void addSample(QDKBenchResult *result, qint64 ns)
+{
+    if ((result->rounds == 0) || (ns < result->best))
+        result->best = ns;
+    result->total += ns;
+    result->rounds++;
+}
+
+static QDKBenchResult newResult(QString name)
+{
+    QDKBenchResult result;
+    result.name = name;
+    result.rounds = 0;
+    result.best = 0;
+    result.total = 0;
+    return result;
+}
+
+static QDKBenchResult run(QString name, QDKBenchmark *bench, QDKBenchFunc func)
+{
+    QDKBenchResult result = newResult(name);
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+        addSample(&result, (bench->*func)());
+    return result;
+}
+
+static void writeJson(QTextStream &out, const QList<QDKBenchResult> &results)
+{
+    // times in ms; names stay the same between revisions so runs can be diffed
+    out << "{\n  \"benchmarks\": [\n";
+    for (int i = 0; i < results.size(); i++)
+    {
+        const QDKBenchResult &r = results.at(i);
+        out << "    {\"name\": \"" << r.name << "\", \"rounds\": " << r.rounds;
+        out << ", \"best_ms\": " << QString::number(r.best / 1000000.0, 'f', 4);
+        out << ", \"mean_ms\": " << QString::number(r.total / 1000000.0 / qMax(r.rounds, 1), 'f', 4) << "}";
+        out << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication a(argc, argv);
+    QList<QDKBenchResult> results;
+
+    // usage: eDKitBenchmarks [output.json] - otherwise the results go to stdout
+    QString outFile = (a.arguments().size() > 1) ? a.arguments().at(1) : QString();
+
+    // random tile data for one full tileset
+    QByteArray data(BENCH_TILES * GB_TILE_BYTES, (char)0x00);
+    qsrand(0x2bb);
+    for (int i = 0; i < data.size(); i++)
+        data[i] = (char)(qrand() & 0xFF);
+
+    QImage pixelImg(128, 352, QImage::Format_Indexed8);
+    QImage tableImg(128, 352, QImage::Format_Indexed8);
+    pixelImg.setColorCount(4);
+    tableImg.setColorCount(4);
+
+    QDKBenchResult pixelResult = newResult("tile_decode_setpixel");
+    QDKBenchResult tableResult = newResult("tile_decode_table");
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        addSample(&pixelResult, runTileDecode(data, &pixelImg, false));
+        addSample(&tableResult, runTileDecode(data, &tableImg, true));
+    }
+
+    if (pixelImg != tableImg)
+    {
+        qWarning("tile decode: results differ!");
+        return 1;
+    }
+
+    results << pixelResult << tableResult;
+
+    // everything else needs the editor and the base rom
+    if (!QFile::exists(BASE_ROM))
+    {
+        qWarning("%s not found - only the tile decoder was measured", BASE_ROM);
+    }
+    else
+    {
+        QDKEdit edit;
+        QDKBenchmark bench(&edit);
+
+        if (!bench.prepare(BASE_ROM))
+            return 1;
+
+        results << run("lzss_compress", &bench, &QDKBenchmark::lzssCompress);
+        results << run("lzss_decompress", &bench, &QDKBenchmark::lzssDecompress);
+        results << run("read_level", &bench, &QDKBenchmark::readLevels);
+        results << run("recompress_level", &bench, &QDKBenchmark::recompressLevels);
+        results << run("save_all_levels", &bench, &QDKBenchmark::saveAllLevels);
+        results << run("create_tilesets", &bench, &QDKBenchmark::createTileSets);
+        results << run("update_tileset_uncached", &bench, &QDKBenchmark::updateTilesetUncached);
+        results << run("update_tileset_cached", &bench, &QDKBenchmark::updateTilesetCached);
+        results << run("calc_vram_usage", &bench, &QDKBenchmark::calcVRAMusage);
+
+        for (int zoom = 1; zoom <= 4; zoom *= 2)
+        {
+            QDKBenchResult result = newResult(QString("paint_level_x%1").arg(zoom));
+            for (int round = 0; round < BENCH_ROUNDS; round++)
+                addSample(&result, bench.paintLevel(zoom));
+            results << result;
+        }
+    }
+
+    if (outFile.isEmpty())
+    {
+        QTextStream out(stdout);
+        writeJson(out, results);
+    }
+    else
+    {
+        QFile file(outFile);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            qWarning("Could not write %s", qPrintable(outFile));
+            return 1;
+        }
+        QTextStream out(&file);
+        writeJson(out, results);
+    }
+
+    return 0;
+}
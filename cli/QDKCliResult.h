@@ -0,0 +1,24 @@
+#ifndef QDKCLIRESULT_H
+#define QDKCLIRESULT_H
+
+#include <QtCore/QString>
+
+// one line of the JSON summary
+struct QDKCliResult
+{
+    QString output;
+    int levels;
+    bool ok;
+    QString error;
+    qint64 ns;
+};
+
+// timed stage of the verify command, the budget covers all levels
+struct QDKCliStage
+{
+    QString name;
+    qint64 ns;
+    qint64 budgetMs;
+};
+
+#endif // QDKCLIRESULT_H
@@ -0,0 +1,212 @@
+#include "QDKVerify.h"
+
+#include <QtCore/QBuffer>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+
+enum
+{
+    STAGE_DECODE,
+    STAGE_RECOMPRESS,
+    STAGE_LZSS,
+    STAGE_REDECODE
+};
+
+QDKVerify::QDKVerify(const QByteArray &romData, const QDKRom &base) :
+    identicalToRom(0),
+    romData(romData)
+{
+    // the base rom stays untouched
+    rom = new QDKRom(base);
+    scratch = new QDKRom(base);
+
+    QDKCliStage stage;
+    stage.ns = 0;
+
+    stage.name = "decode";
+    stage.budgetMs = VERIFY_BUDGET_DECODE;
+    stages.append(stage);
+
+    stage.name = "recompress";
+    stage.budgetMs = VERIFY_BUDGET_RECOMPRESS;
+    stages.append(stage);
+
+    stage.name = "lzss";
+    stage.budgetMs = VERIFY_BUDGET_LZSS;
+    stages.append(stage);
+
+    stage.name = "redecode";
+    stage.budgetMs = VERIFY_BUDGET_REDECODE;
+    stages.append(stage);
+}
+
+QDKVerify::~QDKVerify()
+{
+    delete rom;
+    delete scratch;
+}
+
+bool QDKVerify::setBudget(QString stage, int ms)
+{
+    for (int i = 0; i < stages.size(); i++)
+        if (stages.at(i).name == stage)
+        {
+            stages[i].budgetMs = ms;
+            return true;
+        }
+
+    return false;
+}
+
+bool QDKVerify::loadReference(QString directory)
+{
+    QDir dir(directory);
+
+    reference.clear();
+    for (int id = 0; id < MAX_LEVEL_ID; id++)
+    {
+        QFile file(dir.filePath(QString("level_%1.lvl").arg(id, 2, 16, QChar('0'))));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+
+        // skip the palette byte
+        reference.insert(id, file.readAll().mid(1));
+    }
+
+    return !reference.isEmpty();
+}
+
+void QDKVerify::run(const QList<int> &ids)
+{
+    QBuffer buffer;
+    buffer.setData(romData);
+    buffer.open(QIODevice::ReadOnly);
+
+    QElapsedTimer timer;
+    QVector<qint64> levelNs(MAX_LEVEL_ID, 0);
+    QStringList errors;
+    qint64 ns;
+    int id;
+
+    // decode
+    for (int i = 0; i < ids.size(); i++)
+    {
+        id = ids.at(i);
+
+        timer.start();
+        rom->readLevel(&buffer, id);
+        ns = timer.nsecsElapsed();
+
+        stages[STAGE_DECODE].ns += ns;
+        levelNs[id] += ns;
+        original[id] = rom->levels[id].fullData;
+    }
+
+    // recompress
+    identicalToRom = 0;
+    for (int i = 0; i < ids.size(); i++)
+    {
+        id = ids.at(i);
+        rom->levels[id].fullDataUpToDate = false;
+
+        timer.start();
+        rom->recompressLevel(id);
+        ns = timer.nsecsElapsed();
+
+        stages[STAGE_RECOMPRESS].ns += ns;
+        levelNs[id] += ns;
+
+        // an unchanged level has to come out exactly as stored in the rom
+        if (rom->levels[id].fullData == original[id])
+            identicalToRom++;
+        errors.append((rom->levels[id].fullData != original[id]) ? "recompressed bytes differ from rom" : QString());
+    }
+
+    // lzss
+    for (int i = 0; i < ids.size(); i++)
+    {
+        id = ids.at(i);
+        QByteArray raw = QDKRom::rawTilemap(rom->levels[id].tilemap);
+        QByteArray unpacked;
+
+        timer.start();
+        QByteArray packed = QDKRom::LZSSCompress(&raw);
+        {
+            QBuffer in(&packed);
+            in.open(QIODevice::ReadOnly);
+            QDataStream stream(&in);
+            unpacked = QDKRom::LZSSDecompress(&stream, raw.size());
+        }
+        ns = timer.nsecsElapsed();
+
+        stages[STAGE_LZSS].ns += ns;
+        levelNs[id] += ns;
+
+        if (errors.at(i).isEmpty() && (unpacked != raw))
+            errors[i] = "LZSS round trip differs";
+    }
+
+    // redecode
+    for (int i = 0; i < ids.size(); i++)
+    {
+        id = ids.at(i);
+
+        QByteArray data;
+        data.append((char)(rom->levels[id].paletteIndex - 0x180));
+        data.append(rom->levels[id].fullData);
+
+        QBuffer lvl(&data);
+        lvl.open(QIODevice::ReadOnly);
+
+        timer.start();
+        scratch->readLevel(&lvl, id, true);
+        ns = timer.nsecsElapsed();
+
+        stages[STAGE_REDECODE].ns += ns;
+        levelNs[id] += ns;
+
+        if (errors.at(i).isEmpty())
+            errors[i] = compareLevel(id);
+
+        QDKCliResult result;
+        result.output = QString("level 0x%1").arg(id, 2, 16, QChar('0'));
+        result.levels = 1;
+        result.ok = errors.at(i).isEmpty();
+        result.error = errors.at(i);
+        result.ns = levelNs.at(id);
+        results.append(result);
+    }
+}
+
+QString QDKVerify::compareLevel(int id)
+{
+    const QDKLevel *lvl = &rom->levels[id];
+    QDKLevel *decoded = &scratch->levels[id];
+
+    if (decoded->tilemap != lvl->tilemap)
+        return "tilemap differs after decoding";
+
+    if (decoded->rawSwitchData != lvl->rawSwitchData)
+        return "switch data differs after decoding";
+
+    if (decoded->rawAddSpriteData != lvl->rawAddSpriteData)
+        return "sprite flags differ after decoding";
+
+    // the encoder has to be stable on its own output
+    decoded->fullDataUpToDate = false;
+    scratch->recompressLevel(id);
+    if (decoded->fullData != lvl->fullData)
+        return "recompressing the decoded level gives different bytes";
+
+    if (reference.contains(id) && (reference.value(id) != lvl->fullData))
+        return "recompressed bytes differ from the reference";
+
+    return QString();
+}
+
+bool QDKVerify::withinBudget(int stage) const
+{
+    return (stages.at(stage).ns / 1000000) <= stages.at(stage).budgetMs;
+}
@@ -0,0 +1,52 @@
+#ifndef QDKVERIFY_H
+#define QDKVERIFY_H
+
+#include "QDKCliResult.h"
+#include "QDKRom.h"
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+// default time budgets in ms for all MAX_LEVEL_ID levels
+#define VERIFY_BUDGET_DECODE 250
+#define VERIFY_BUDGET_RECOMPRESS 1000
+#define VERIFY_BUDGET_LZSS 1000
+#define VERIFY_BUDGET_REDECODE 250
+
+// round trip of every level through the level codecs:
+//   decode     readLevel from the rom
+//   recompress recompressLevel (switch/sprite flag RLE, LZSS, sprite list)
+//              gives the same bytes as stored in the rom
+//   lzss       LZSSDecompress(LZSSCompress(raw tilemap)) == raw tilemap
+//   redecode   readLevel of the recompressed bytes gives the same raw data,
+//              recompressing that again gives the same bytes
+// with a reference directory (level_XX.lvl from "export") the recompressed
+// bytes must also be identical to the reference files
+class QDKVerify
+{
+public:
+    QDKVerify(const QByteArray &romData, const QDKRom &base);
+    ~QDKVerify();
+
+    bool setBudget(QString stage, int ms);
+    bool loadReference(QString directory);
+    void run(const QList<int> &ids);
+    bool withinBudget(int stage) const;
+
+    QList<QDKCliResult> results;
+    QList<QDKCliStage> stages;
+    int identicalToRom;
+
+private:
+    QString compareLevel(int id);
+
+    const QByteArray &romData;
+    QDKRom *rom;
+    QDKRom *scratch;
+    QByteArray original[MAX_LEVEL_ID];
+    QMap<int, QByteArray> reference;
+};
+
+#endif // QDKVERIFY_H
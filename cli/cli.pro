@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# eDKit command line tool
+# builds rom variants from .lvl files without any widgets
+# verifies the level codecs (verify command) and
+# looks up tile and sprite usage (usage command)
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += core
+
+TARGET = eDKitCli
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+INCLUDEPATH += ../core
+DEPENDPATH += ../core
+
+SOURCES += main.cpp\
+        QDKVerify.cpp
+
+HEADERS  += QDKCliResult.h\
+        QDKVerify.h
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/../core/release/ -leDKitCore
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/../core/debug/ -leDKitCore
+else:unix: LIBS += -L$$OUT_PWD/../core/ -leDKitCore
+
+unix: PRE_TARGETDEPS += $$OUT_PWD/../core/libeDKitCore.a
@@ -0,0 +1,498 @@
+#include <QtCore/QBuffer>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegExp>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+
+#include "QDKCliResult.h"
+#include "QDKRom.h"
+#include "QDKUsageIndex.h"
+#include "QDKVerify.h"
+
+// exit codes
+#define EXIT_OK 0
+#define EXIT_USAGE 1
+#define EXIT_BASE_ROM 2
+#define EXIT_FAILED 3 // at least one output could not be written or verified
+
+static void usage()
+{
+    QTextStream err(stderr);
+    err << "usage: eDKitCli [--summary <file.json>] <base.gb> <command>" << endl;
+    err << endl;
+    err << "commands:" << endl;
+    err << "  build <output.gb> [--recompress] [<id>=<file.lvl> ...]" << endl;
+    err << "      write one rom with the given levels replaced" << endl;
+    err << "  batch <variants.txt>" << endl;
+    err << "      one build per line: <output.gb> [--recompress] [<id>=<file.lvl> ...]" << endl;
+    err << "      paths are relative to the variants file, # starts a comment" << endl;
+    err << "  export <directory> [<id> ...]" << endl;
+    err << "      write level_XX.lvl files (all levels if no id is given)" << endl;
+    err << "  verify [--reference <directory>] [--budget <stage>=<ms> ...] [<id> ...]" << endl;
+    err << "      round trip levels through decoding and recompression (all 256 if no" << endl;
+    err << "      id is given); stages: decode recompress lzss redecode" << endl;
+    err << "  usage tile|sprite <id>" << endl;
+    err << "      list the levels and positions using a tile or sprite id" << endl;
+    err << endl;
+    err << "level ids may be decimal or 0x hex; the summary is printed as JSON" << endl;
+    err << "to stdout unless --summary is given" << endl;
+}
+
+static QString jsonString(QString text)
+{
+    QString escaped;
+
+    for (int i = 0; i < text.size(); i++)
+    {
+        QChar c = text.at(i);
+        if ((c == '"') || (c == '\\'))
+            escaped += QString("\\") + c;
+        else if (c.unicode() < 0x20)
+            escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        else
+            escaped += c;
+    }
+
+    return "\"" + escaped + "\"";
+}
+
+static bool parseLevelID(QString text, int *id)
+{
+    bool ok;
+    *id = text.toInt(&ok, 0);
+
+    // only these are written back to the rom
+    return ok && (*id >= 0) && (*id < LAST_LEVEL);
+}
+
+static bool loadBase(QString filename, QByteArray *data, QDKRom *rom)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    *data = file.readAll();
+    file.close();
+
+    QBuffer buffer(data);
+    buffer.open(QIODevice::ReadOnly);
+
+    if (!rom->getTileInfo(&buffer))
+        return false;
+
+    return rom->readAllLevels(&buffer);
+}
+
+// spec: <output.gb> [--recompress] [<id>=<file.lvl> ...]
+static QDKCliResult buildVariant(const QByteArray &baseData, const QDKRom &base, QStringList spec, QDir dir)
+{
+    QDKCliResult result;
+    result.levels = 0;
+    result.ok = false;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    result.output = dir.filePath(spec.takeFirst());
+
+    // the levels are implicitly shared so copying the parsed base rom is cheap
+    QDKRom *rom = new QDKRom(base);
+    bool recompress = false;
+    int id;
+
+    for (int i = 0; i < spec.size(); i++)
+    {
+        if (spec.at(i) == "--recompress")
+        {
+            recompress = true;
+            continue;
+        }
+
+        QStringList level = spec.at(i).split('=');
+        if ((level.size() != 2) || !parseLevelID(level.at(0), &id))
+        {
+            result.error = QString("invalid level argument %1").arg(spec.at(i));
+            break;
+        }
+
+        QFile lvl(dir.filePath(level.at(1)));
+        if (!lvl.open(QIODevice::ReadOnly) || !rom->importLevel(id, &lvl))
+        {
+            result.error = QString("could not read %1").arg(lvl.fileName());
+            break;
+        }
+
+        result.levels++;
+    }
+
+    if (result.error.isEmpty())
+    {
+        if (recompress)
+            for (int i = 0; i < LAST_LEVEL; i++)
+                rom->levels[i].fullDataUpToDate = false;
+
+        // pack everything into a copy of the base rom
+        QByteArray data = baseData;
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadWrite);
+
+        if (!rom->writeAllLevels(&buffer))
+            result.error = "levels don't fit into the rom banks";
+        else
+        {
+            QFile out(result.output);
+            if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate) || (out.write(data) != data.size()))
+                result.error = QString("could not write %1").arg(result.output);
+            else
+                result.ok = true;
+        }
+    }
+
+    delete rom;
+
+    result.ns = timer.nsecsElapsed();
+    return result;
+}
+
+static QList<QDKCliResult> exportLevels(QDKRom *rom, QString directory, QStringList ids)
+{
+    QList<QDKCliResult> results;
+    QList<int> levels;
+    QDir dir(directory);
+    int id;
+
+    if (ids.isEmpty())
+        for (int i = 0; i < LAST_LEVEL; i++)
+            levels.append(i);
+
+    for (int i = 0; i < ids.size(); i++)
+    {
+        if (parseLevelID(ids.at(i), &id))
+            levels.append(id);
+        else
+        {
+            QDKCliResult result;
+            result.output = ids.at(i);
+            result.levels = 0;
+            result.ok = false;
+            result.error = "invalid level id";
+            result.ns = 0;
+            results.append(result);
+        }
+    }
+
+    if (!dir.exists())
+        dir.mkpath(".");
+
+    QElapsedTimer timer;
+
+    for (int i = 0; i < levels.size(); i++)
+    {
+        timer.start();
+
+        QDKCliResult result;
+        result.output = dir.filePath(QString("level_%1.lvl").arg(levels.at(i), 2, 16, QChar('0')));
+        result.levels = 1;
+        result.ok = false;
+
+        QFile file(result.output);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            result.error = QString("could not write %1").arg(result.output);
+        else
+            result.ok = rom->exportLevel(levels.at(i), &file);
+
+        result.ns = timer.nsecsElapsed();
+        results.append(result);
+    }
+
+    return results;
+}
+
+// args: [--reference <directory>] [--budget <stage>=<ms> ...] [<id> ...]
+static bool verifyLevels(const QByteArray &baseData, const QDKRom &base, QStringList args, QList<QDKCliResult> *results, QList<QDKCliStage> *stages, int *identicalToRom)
+{
+    QDKVerify verify(baseData, base);
+    QList<int> ids;
+    bool ok;
+    int id;
+
+    while (!args.isEmpty())
+    {
+        QString arg = args.takeFirst();
+
+        if ((arg == "--reference") && !args.isEmpty())
+        {
+            if (!verify.loadReference(args.first()))
+            {
+                qWarning("No level_XX.lvl files found in %s", qPrintable(args.first()));
+                return false;
+            }
+            args.removeFirst();
+        }
+        else if ((arg == "--budget") && !args.isEmpty())
+        {
+            QStringList budget = args.takeFirst().split('=');
+            if ((budget.size() != 2) || !verify.setBudget(budget.at(0), budget.at(1).toInt(&ok)) || !ok)
+            {
+                qWarning("Invalid budget %s", qPrintable(budget.join("=")));
+                return false;
+            }
+        }
+        else
+        {
+            // unlike the other commands unused level ids are allowed here
+            id = arg.toInt(&ok, 0);
+            if (!ok || (id < 0) || (id >= MAX_LEVEL_ID))
+            {
+                qWarning("Invalid level id %s", qPrintable(arg));
+                return false;
+            }
+            ids.append(id);
+        }
+    }
+
+    if (ids.isEmpty())
+        for (int i = 0; i < MAX_LEVEL_ID; i++)
+            ids.append(i);
+
+    verify.run(ids);
+
+    *results = verify.results;
+    *stages = verify.stages;
+
+    // a stage over its budget fails the run like a mismatching level
+    for (int i = 0; i < verify.stages.size(); i++)
+        if (!verify.withinBudget(i))
+        {
+            QDKCliResult result;
+            result.output = QString("stage %1").arg(verify.stages.at(i).name);
+            result.levels = ids.size();
+            result.ok = false;
+            result.error = QString("took %1 ms, budget is %2 ms").arg(verify.stages.at(i).ns / 1000000).arg(verify.stages.at(i).budgetMs);
+            result.ns = verify.stages.at(i).ns;
+            results->append(result);
+        }
+
+    QTextStream err(stderr);
+    err << QString("%1 of %2 levels recompress to the bytes in the rom").arg(verify.identicalToRom).arg(ids.size()) << endl;
+    *identicalToRom = verify.identicalToRom;
+
+    return true;
+}
+
+// args: tile|sprite <id>
+static bool findUsage(const QDKRom *rom, QStringList args, QVector<QDKUsage> *uses, QList<QDKCliStage> *stages)
+{
+    bool ok;
+    int id = (args.size() == 2) ? args.at(1).toInt(&ok, 0) : -1;
+
+    if ((args.size() != 2) || !ok || (id < 0) || (id > 0xFF) || ((args.at(0) != "tile") && (args.at(0) != "sprite")))
+    {
+        qWarning("Invalid usage query %s", qPrintable(args.join(" ")));
+        return false;
+    }
+
+    QElapsedTimer timer;
+    QDKCliStage stage;
+    stage.budgetMs = 0;
+
+    QDKUsageIndex index;
+
+    timer.start();
+    index.build(rom);
+    stage.name = "index";
+    stage.ns = timer.nsecsElapsed();
+    stages->append(stage);
+
+    timer.start();
+    *uses = (args.at(0) == "tile") ? index.tileUsage(id) : index.spriteUsage(id);
+    stage.name = "query";
+    stage.ns = timer.nsecsElapsed();
+    stages->append(stage);
+
+    return true;
+}
+
+static void writeSummary(QTextStream &out, QString base, QString command, const QList<QDKCliResult> &results, const QList<QDKCliStage> &stages, const QVector<QDKUsage> &uses, int identicalToRom, int failed, qint64 ns)
+{
+    out << "{\n";
+    out << "  \"base\": " << jsonString(base) << ",\n";
+    out << "  \"command\": " << jsonString(command) << ",\n";
+    out << "  \"ok\": " << (failed ? "false" : "true") << ",\n";
+    out << "  \"failed\": " << failed << ",\n";
+    out << "  \"total_ms\": " << QString::number(ns / 1000000.0, 'f', 3) << ",\n";
+
+    // verify only: levels that recompress to the bytes in the rom
+    if (identicalToRom >= 0)
+        out << "  \"identical_to_rom\": " << identicalToRom << ",\n";
+
+    if (!stages.isEmpty())
+    {
+        out << "  \"stages\": [\n";
+        for (int i = 0; i < stages.size(); i++)
+        {
+            out << "    {\"name\": " << jsonString(stages.at(i).name);
+            out << ", \"ms\": " << QString::number(stages.at(i).ns / 1000000.0, 'f', 3);
+            out << ", \"budget_ms\": " << stages.at(i).budgetMs << "}";
+            out << ((i + 1 < stages.size()) ? ",\n" : "\n");
+        }
+        out << "  ],\n";
+    }
+
+    if (!uses.isEmpty())
+    {
+        out << "  \"uses\": [\n";
+        for (int i = 0; i < uses.size(); i++)
+        {
+            out << "    {\"level\": " << (int)uses.at(i).level;
+            out << ", \"x\": " << (int)uses.at(i).x;
+            out << ", \"y\": " << (int)uses.at(i).y << "}";
+            out << ((i + 1 < uses.size()) ? ",\n" : "\n");
+        }
+        out << "  ],\n";
+    }
+
+    out << "  \"results\": [\n";
+
+    for (int i = 0; i < results.size(); i++)
+    {
+        const QDKCliResult &r = results.at(i);
+        out << "    {\"output\": " << jsonString(r.output);
+        out << ", \"ok\": " << (r.ok ? "true" : "false");
+        out << ", \"levels\": " << r.levels;
+        out << ", \"ms\": " << QString::number(r.ns / 1000000.0, 'f', 3);
+        out << ", \"error\": " << jsonString(r.error) << "}";
+        out << ((i + 1 < results.size()) ? ",\n" : "\n");
+    }
+
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList args = a.arguments();
+    args.removeFirst();
+
+    QString summaryFile;
+    if ((args.size() > 1) && (args.at(0) == "--summary"))
+    {
+        summaryFile = args.at(1);
+        args = args.mid(2);
+    }
+
+    if ((args.size() < 3) && !((args.size() == 2) && (args.at(1) == "verify")))
+    {
+        usage();
+        return EXIT_USAGE;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QString baseFile = args.takeFirst();
+    QString command = args.takeFirst();
+
+    // the base rom is parsed only once for all outputs
+    QByteArray baseData;
+    QDKRom *base = new QDKRom();
+    if (!loadBase(baseFile, &baseData, base))
+    {
+        qWarning("Could not load base rom %s", qPrintable(baseFile));
+        delete base;
+        return EXIT_BASE_ROM;
+    }
+
+    QList<QDKCliResult> results;
+    QList<QDKCliStage> stages;
+    QVector<QDKUsage> uses;
+    int identicalToRom = -1;
+
+    if (command == "build")
+        results.append(buildVariant(baseData, *base, args, QDir::current()));
+    else if (command == "batch")
+    {
+        QFile list(args.at(0));
+        if (!list.open(QIODevice::ReadOnly | QIODevice::Text))
+        {
+            qWarning("Could not read %s", qPrintable(args.at(0)));
+            delete base;
+            return EXIT_USAGE;
+        }
+
+        QDir dir = QFileInfo(list).absoluteDir();
+        QTextStream in(&list);
+        QString line;
+        QStringList spec;
+
+        while (!in.atEnd())
+        {
+            line = in.readLine();
+            if (line.contains('#'))
+                line.truncate(line.indexOf('#'));
+
+            spec = line.split(QRegExp("\\s+"), QString::SkipEmptyParts);
+            if (!spec.isEmpty())
+                results.append(buildVariant(baseData, *base, spec, dir));
+        }
+    }
+    else if (command == "export")
+        results = exportLevels(base, args.takeFirst(), args);
+    else if (command == "verify")
+    {
+        if (!verifyLevels(baseData, *base, args, &results, &stages, &identicalToRom))
+        {
+            usage();
+            delete base;
+            return EXIT_USAGE;
+        }
+    }
+    else if (command == "usage")
+    {
+        if (!findUsage(base, args, &uses, &stages))
+        {
+            usage();
+            delete base;
+            return EXIT_USAGE;
+        }
+    }
+    else
+    {
+        usage();
+        delete base;
+        return EXIT_USAGE;
+    }
+
+    delete base;
+
+    int failed = 0;
+    for (int i = 0; i < results.size(); i++)
+        if (!results.at(i).ok)
+        {
+            qWarning("%s: %s", qPrintable(results.at(i).output), qPrintable(results.at(i).error));
+            failed++;
+        }
+
+    if (summaryFile.isEmpty())
+    {
+        QTextStream out(stdout);
+        writeSummary(out, baseFile, command, results, stages, uses, identicalToRom, failed, timer.nsecsElapsed());
+    }
+    else
+    {
+        QFile file(summaryFile);
+        if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            QTextStream out(&file);
+            writeSummary(out, baseFile, command, results, stages, uses, identicalToRom, failed, timer.nsecsElapsed());
+        }
+        else
+            qWarning("Could not write %s", qPrintable(summaryFile));
+    }
+
+    return failed ? EXIT_FAILED : EXIT_OK;
+}
@@ -0,0 +1,1570 @@
+#include "QDKRom.h"
+#include "QDKTrace.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QSet>
+
+bool QDKRom::isSprite[] = {
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, true , false, false, false, false, false,
+    false, false, false, false, true , false, false, true ,
+    true , false, false, false, false, true , true , true ,
+    true , false, false, false, true , false, false, true ,
+    true , false, true , false, true , false, true , false,
+    false, false, false, false, true , false, false, false,
+    false, false, false, false, false, false, true , false,
+    true, false, true, false, false, false, false, false,
+    false, false, true , false, true , false, false, true ,
+    true , false, false, false, true , false, true , false,
+    true , false, true , false, false, false, true , false,
+    true , false, true , false, true , false, true , false,
+    true , false, true , false, false, true , false, false,
+    false, false, true , false, true , false, true , false,
+    true , false, true , false, true , false, true , false,
+    true , false, false, false, false, false, true , false,
+    true , false, true , false, false, false, true , false,
+    true , false, true , false, false, false, true , false,
+    true , false, true , false, true , false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false,
+    false, false, false, false, false, false, false, false
+};
+
+QDKRom::QDKRom()
+{
+}
+
+bool QDKRom::readAllLevels(QIODevice *rom)
+{
+    QDKTraceScope trace("readAllLevels");
+
+    bool allOkay = true;
+
+    QDataStream in(rom);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    // we first get the three used rom banks from the asm code
+    // the first bank (0x05) contains MAX_LEVEL_ID 16bit pointers
+    // everything else is available for level data
+
+    //get used rom banks and limits
+    quint8 rombank[3];
+    quint8 rombankLimit[2];
+    quint8 bank;
+    quint16 pointer;
+
+    rombank[0] = ROMBANK_1;
+
+    rom->seek(ROMBANK_POS_2);
+    in >> rombank[1];
+
+    rom->seek(ROMBANK_POS_3);
+    in >> rombank[2];
+
+    rom->seek(COMPARE_POS_1);
+    in >> rombankLimit[0];
+
+    rom->seek(COMPARE_POS_2);
+    in >> rombankLimit[1];
+
+    //read pointers
+    rom->seek(POINTER_TABLE);
+    for (int i = 0; i < MAX_LEVEL_ID; i++)
+    {
+        if (i < rombankLimit[0])
+            bank = 0;
+        else if (i < rombankLimit[1])
+            bank = 1;
+        else
+            bank = 2;
+
+        in >> pointer;
+
+        levels[i].id = i;
+        levels[i].rombank = rombank[bank];
+        levels[i].offset = (rombank[bank] - 1 ) * 0x4000 + pointer;
+        levels[i].fullDataUpToDate = false;
+
+        //qDebug() << QString("Level %1 -- Rombank %2 -- Offset 0x%3").arg(i).arg(levels[i].rombank).arg(levels[i].offset, 6, 16, QChar('0'));
+    }
+
+    //read raw data
+    for (int i = 0; i < MAX_LEVEL_ID; i++)
+        if (!readLevel(rom, i))
+            allOkay = false;
+
+    return allOkay;
+}
+
+bool QDKRom::writeAllLevels(QIODevice *rom)
+{
+    QDataStream out(rom);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    // get used rom banks and limits
+    quint8 rombank[3];
+    quint8 rombankLimit[2];
+    quint8 currentBank;
+    quint16 pointer;
+
+    rombank[0] = ROMBANK_1;
+
+    rom->seek(ROMBANK_POS_2);
+    out >> rombank[1];
+
+    rom->seek(ROMBANK_POS_3);
+    out >> rombank[2];
+
+    rom->seek(POINTER_TABLE + (MAX_LEVEL_ID * 2));
+    currentBank = 0;
+
+    for (int i = 0; i < LAST_LEVEL; i++)
+    {
+        // recompress level data - this checks wheather it was changed
+        recompressLevel(i);
+
+        // check if the rom bank is full
+        pointer = (rom->pos() % 0x4000) + 0x4000;
+
+        if ((pointer + levels[i].fullData.size()) > 0x8000)
+        {
+            if (currentBank > 1)
+            {
+                qWarning() << QString("Level %1: No more free space for level data! Aborting!").arg(i);
+                return false;
+            }
+
+            // remember new rombank limit
+            rombankLimit[currentBank] = i;
+            currentBank++;
+
+            rom->seek(rombank[currentBank] * 0x4000);
+            pointer = (rom->pos() % 0x4000) + 0x4000;
+        }
+
+        // update rom bank and offset
+        levels[i].rombank = rombank[currentBank];
+        levels[i].offset = rom->pos();
+
+        // write level data
+        if (rom->write(levels[i].fullData) != levels[i].fullData.size())
+        {
+            qWarning() << QString("Writing level %1 failed! Aborting!").arg(i);
+            return false;
+        }
+    }
+
+    //write SGB palettes for all levels
+    for (int i = 0; i < LAST_LEVEL; i++)
+        if (i < 4) // this may cause the game to freeze for "high" palette values !
+        {
+            rom->seek(PAL_ARCADE + (i * 6));
+            out << (quint8)(levels[i].paletteIndex - 0x180 + 0xC8);
+        }
+        else
+        {
+            rom->seek(PAL_TABLE + ((i-4) * 6));
+            out << (quint8)(levels[i].paletteIndex - 0x180);
+        }
+
+
+    // write new pointers back to the table
+    rom->seek(POINTER_TABLE);
+    for (int i = 0; i < LAST_LEVEL; i++)
+        out << (quint16)(levels[i].offset % 0x4000 + 0x4000);
+
+    for (int i = LAST_LEVEL; i < MAX_LEVEL_ID; i++)
+        out << (quint16)(levels[LAST_LEVEL].offset % 0x4000 + 0x4000);
+
+    // correct rombank limits
+    rom->seek(COMPARE_POS_1);
+    out << rombankLimit[0];
+
+    rom->seek(COMPARE_POS_2);
+    out << rombankLimit[1];
+
+    // fix checksum
+    rom->seek(0);
+    quint16 chksum = 0;
+    quint16 orgChksum;
+    quint8 headerchksum = 0;
+    quint8 orgHeader = 0;
+    quint8 byte;
+    for (quint32 i = 0; i < rom->size(); i++)
+    {
+        out >> byte;
+        if (i < 0x0134)
+                chksum += (quint16)byte;
+        else if (i < 0x014D)
+        {
+            chksum += (quint16)byte;
+            headerchksum += byte;
+        }
+        else if (i == 0x014D)
+            orgHeader = byte;
+        else if (i == 0x014E)
+            orgChksum = (((quint16)byte) << 8);
+        else if (i == 0x014F)
+            orgChksum |= (quint16)byte;
+        else
+            chksum += (quint16)byte;
+    }
+
+    headerchksum = (quint8)(0xE7 - headerchksum);
+    if (headerchksum != orgHeader)
+    {
+        rom->seek(0x014D);
+        out << headerchksum;
+        qWarning() << QString("Header checksum was incorrect (0x%1 -> 0x%2)! Are you using a corrupted ROM?!").arg(orgHeader, 4, 16, QChar('0')).arg(headerchksum, 4, 16, QChar('0'));
+    }
+    chksum += (quint16)headerchksum;
+    if (chksum != orgChksum)
+    {
+        rom->seek(0x014E);
+        out.setByteOrder(QDataStream::BigEndian);
+        out << chksum;
+        out.setByteOrder(QDataStream::LittleEndian);
+    }
+
+    /*qDebug() << QString("Header checksum: 0x%1").arg(orgHeader, 2, 16, QChar('0'));
+    qDebug() << QString("Calc header: 0x%1").arg(headerchksum, 2, 16, QChar('0'));
+    qDebug() << QString("Global checksum: 0x%1").arg(orgChksum, 4, 16, QChar('0'));
+    qDebug() << QString("Calc global: 0x%1").arg(chksum, 4, 16, QChar('0'));*/
+
+    return true;
+}
+
+bool QDKRom::readLevel(QIODevice *src, quint8 id, bool fromLvlFile)
+{    
+    QDKTraceScope trace("readLevel", id);
+
+    QDataStream in(src);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint8 byte, flag;
+    quint16 address;
+
+    if (!fromLvlFile)
+        src->seek(levels[id].offset);
+    else
+        src->seek(1);
+
+    in >> levels[id].size;
+    in >> levels[id].music;
+    in >> levels[id].tileset;
+    in >> levels[id].time;
+
+    // switch data
+    levels[id].rawSwitchData.clear();
+    in >> byte;
+    if (byte == 0x00)
+        levels[id].switchData = false;
+    else
+    {
+        levels[id].switchData = true;
+        levels[id].rawSwitchData.append(byte);
+        for (int i = 0; i < 0x10; i++) // 1 byte already read!
+        {
+            in >> byte;
+            levels[id].rawSwitchData.append(byte);
+        }
+
+        //0x90 bytes codiert
+        bool secondRound = false;
+
+        while (levels[id].rawSwitchData.size() < 0xA1)
+        {
+            if (secondRound)
+                in >> byte;
+            else
+                secondRound = true;
+
+            flag = byte;
+            byte = 0x00;
+            if (flag < 0x80)
+                for (int i = 0; i < flag; i++)
+                    levels[id].rawSwitchData.append(byte);
+            else
+            {
+                flag &= 0x7F;
+                for (int i = 0; i < flag; i++)
+                {
+                    in >> byte;
+                    levels[id].rawSwitchData.append(byte);
+                }
+            }
+        }
+
+        if (levels[id].rawSwitchData.size() != 0xA1)
+            qWarning() << QString("Level %1: incorrect size of switch data! size: %2").arg(id).arg(levels[id].rawSwitchData.size());
+    }
+
+    // additional sprite data?
+    levels[id].rawAddSpriteData.clear();
+    in >> byte;
+    if (byte == 0x00)
+        levels[id].addSpriteData = false;
+    else
+    {
+        levels[id].addSpriteData = true;
+
+        bool secondRound = false;
+
+        //0x40 bytes codiert
+        while (levels[id].rawAddSpriteData.size() < 0x40)
+        {
+            if (secondRound)
+                in >> byte;
+            else
+                secondRound = true;
+
+            flag = byte;
+            byte = 0x00;
+            if (flag < 0x80)
+                for (int i = 0; i < flag; i++)
+                    levels[id].rawAddSpriteData.append(byte);
+            else
+            {
+                flag &= 0x7F;
+                for (int i = 0; i < flag; i++)
+                {
+                    in >> byte;
+                    levels[id].rawAddSpriteData.append(byte);
+                }
+            }
+        }
+
+        if (levels[id].rawAddSpriteData.size() != 0x40)
+            qWarning() << QString("Level %1: incorrect size of add. sprite data! size: %2").arg(id).arg(levels[id].rawAddSpriteData.size());
+    }
+
+    //LZSS compressed tilemap
+    quint16 uncompressedSize;
+
+    if (levels[id].size == 0x00)
+        uncompressedSize = 0x240;
+    else
+        uncompressedSize = 0x380;
+
+    levels[id].tilemap = expandTilemap(LZSSDecompress(&in, uncompressedSize));
+
+    //sprite data
+    levels[id].sprites.clear();
+    in >> byte;
+    while (byte != 0x00)
+    {
+        QDKSprite sprite;
+        sprite.id = byte;
+        in >> sprite.ramPos;
+        sprite.levelPos = sprite.ramPos - 0xDA75;
+        sprite.pixelPerfect = false;
+        sprite.x = sprite.levelPos % 32;
+        sprite.y = sprite.levelPos / 32;
+        sprite.sprite = NULL;
+        sprite.rotate = BOTTOM;
+        sprite.flagByte = getSpriteDefaultFlag(byte);
+        sprite.size = QSize(tiles[byte].w, tiles[byte].h);
+
+        if (sprite.id == 0x54)
+            sprite.drawOffset.setX(-0.5f);
+
+        levels[id].sprites.append(sprite);
+
+        in >> byte;
+    }
+
+    if (levels[id].sprites.size() > MAX_SPRITES)
+        qWarning() << QString("Level %1: too many sprites! count: %2").arg(id).arg(levels[id].sprites.size());
+
+    if (levels[id].addSpriteData)
+    {
+        for (int i = 0; i < levels[id].rawAddSpriteData.size(); i+=4)
+        {
+            byte = (quint8)levels[id].rawAddSpriteData[i];
+
+            //asm @ 0x46E6 rombank 0x0C
+            //missing keyholes from lvl95 0xB8 - flag only 00 or 01?
+            //missing DK sprites 9A 6E CC - flag only 00 or 01 ?
+            // 9A handled like 80 98 84
+            // 6E CC handled identical
+
+            // the original game contains much garbage btw...
+
+            if ((byte != 0x7F) && (byte != 0x98) && (byte != 0x80) && (byte != 0x54) && (byte != 0x70) && (byte != 0x72) &&
+                (byte != 0x84) && (byte != 0xB8) && (byte != 0x9A) && (byte != 0x6E) && (byte != 0xCC))
+                continue;
+
+            address = (quint8)levels[id].rawAddSpriteData[i+1] + (0x100 * (quint8)levels[id].rawAddSpriteData[i+2]);
+            flag = (quint8)levels[id].rawAddSpriteData[i+3];
+
+            // elevator actually correspondes to a tile
+            if ((byte == 0x70) || (byte == 0x72))
+            {
+                if (byte == rawTileAt(levels[id].tilemap, address - 0xD44D))
+                {
+                    //we found a correct tile
+                    //so we need a new sprite
+                    QDKSprite sprite;
+                    sprite.id = byte;
+                    sprite.ramPos = address;
+                    sprite.levelPos = sprite.ramPos - 0xD44D;
+                    sprite.pixelPerfect = false;
+                    sprite.x = sprite.levelPos % 32;
+                    sprite.y = sprite.levelPos / 32;
+                    sprite.sprite = NULL;
+                    sprite.rotate = BOTTOM;
+                    sprite.flagByte = flag;
+                    sprite.size = QSize(tiles[byte].w, tiles[byte].h);
+                    levels[id].sprites.append(sprite);
+
+                }
+
+                continue;
+            }
+
+            // these sprites may get mirrored
+            for (int j = 0; j < levels[id].sprites.size(); j++)
+                if (levels[id].sprites.at(j).ramPos == address)
+                {
+                    levels[id].sprites[j].flagByte = flag;
+
+                    //actually the game engine takes 0x7F sprite properties
+                    //without checking the RAM address...
+                    if (byte == 0x7F)
+                        levels[id].sprites[j].rotate = flag;
+                    else if ((byte == 0x80) || (byte == 0x98))
+                        levels[id].sprites[j].rotate = ((flag+1) & 1);
+                    break;
+                }
+        }
+    }
+
+    for (int t = 0; t < levels[id].switches.size(); t++)
+        levels[id].switches[t].connectedTo.clear();
+
+    levels[id].switches.clear();
+    if (levels[id].switchData)
+    {
+        for (int i = 8; i > 0; i--)
+        {
+            if (!(levels[id].rawSwitchData[0] & (1 << (i-1))))
+                continue;
+
+            QDKSwitch newSwitch;
+            quint8 connectedObjectFlags = levels[id].rawSwitchData[i];
+            newSwitch.state = levels[id].rawSwitchData[8+i];
+            newSwitch.ramPos = (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18)] + (0x100 * (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + 1]);
+            newSwitch.levelPos = newSwitch.ramPos - 0xD44D;
+            newSwitch.x = newSwitch.levelPos % 0x20;
+            newSwitch.y = newSwitch.levelPos / 0x20;
+
+            for (int j = 8; j > 0; j--)
+            {
+                if (!(connectedObjectFlags & (1 << (j-1))))
+                    continue;
+
+                QDKSwitchObject newObj;
+                newObj.ramPos = (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + (2*j)] + (0x100 * (quint8)levels[id].rawSwitchData[17 + ((i-1) * 18) + (2*j) + 1]);
+                if (newObj.ramPos < 0xDA00) //tile
+                {
+                    newObj.isSprite = false;
+                    newObj.levelPos = newObj.ramPos - 0xD44D;
+                }
+                else
+                {
+                    newObj.isSprite = true;
+                    newObj.levelPos = newObj.ramPos - 0xDA75;
+                }
+
+                newObj.x = newObj.levelPos % 0x20;
+                newObj.y = newObj.levelPos / 0x20;
+
+                newSwitch.connectedTo.append(newObj);
+            }
+
+            levels[id].switches.append(newSwitch);
+        }
+    }
+
+    //copy the full raw data
+    //no need to recompress if level data needs to be relocated
+    quint32 size;
+    if (!fromLvlFile)
+    {
+        size = src->pos() - levels[id].offset;
+        src->seek(levels[id].offset);
+    }
+    else
+    {
+        size = src->size() - 1;
+        src->seek(1);
+    }
+
+    //get palette number
+    levels[id].fullData.clear();
+    for (quint32 i = 0; i < size; i++)
+    {
+        in >> byte;
+        levels[id].fullData.append(byte);
+    }
+
+    if (fromLvlFile)
+    {
+        src->seek(0);
+        in >> byte;
+    }
+    else if (id < 4)
+    {
+        src->seek(PAL_ARCADE + (id * 6));
+        in >> byte;
+        byte -= 0xC8;
+    }
+    else
+    {
+        src->seek(PAL_TABLE + (id-4)*8);
+        in >> byte;
+    }
+
+    levels[id].paletteIndex = 0x180 + byte;
+
+    if (levels[id].paletteIndex >= 0x200)
+    {
+        if (id <= LAST_LEVEL)
+            qWarning() << QString("Level %1: invalid SGB palette 0x%2! default to 0x180").arg(id).arg(levels[id].paletteIndex, 4, 16, QChar('0'));
+        levels[id].paletteIndex = 0x180;
+    }
+
+    levels[id].fullDataUpToDate = true;
+
+    if ((quint8)levels[id].fullData[size-1] != (quint8)0x00)
+        qWarning() << QString("Level %1: last byte of raw data is not 0x00! byte %2; size %3").arg(id).arg(levels[id].fullData[size-1], 2, 16, QChar('0')).arg(size);
+
+    return true;
+}
+
+bool QDKRom::exportLevel(quint8 id, QIODevice *dst)
+{
+    recompressLevel(id);
+
+    QDataStream out(dst);
+    out.setByteOrder(QDataStream::LittleEndian);
+    // palette
+    quint8 pal = (quint8)(levels[id].paletteIndex - 0x180);
+    out << pal;
+
+    // write level data
+    if (dst->write(levels[id].fullData) != levels[id].fullData.size())
+    {
+        qWarning() << QString("Writing level %1 failed! Aborting!").arg(id);
+        return false;
+    }
+
+    return true;
+}
+
+bool QDKRom::importLevel(quint8 id, QIODevice *src)
+{
+    return readLevel(src, id, true);
+}
+
+bool QDKRom::readSGBPalettes(QIODevice *src)
+{
+    QDKTraceScope trace("readSGBPalettes");
+
+    src->seek(SGB_SYSTEM_PAL);
+    QDataStream in(src);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+//    Bit 0-4   - Red Intensity   (0-31)
+//    Bit 5-9   - Green Intensity (0-31)
+//    Bit 10-14 - Blue Intensity  (0-31)
+//    Bit 15    - Not used (zero)
+
+    QByteArray decompressed = LZSSDecompress(&in, 0x1000);
+    if (decompressed.size() < 0x1000)
+    {
+        qWarning() << QString("SGB system palettes: decompressed size 0x%1 instead of 0x1000!").arg(decompressed.size(), 4, 16, QChar('0'));
+        return false;
+    }
+
+    const uchar *data = (const uchar *)decompressed.constData();
+
+    for (int i = 0; i < 512; i++)
+        for (int j = 0; j < 4; j++)
+        {
+            sgbPalettes[i][j] = data[0] | (data[1] << 8);
+            data += 2;
+        }
+
+    return true;
+}
+
+void QDKRom::rebuildSwitchData(int id)
+{
+    QDKLevel *lvl = &levels[id];
+
+    lvl->rawSwitchData.clear();
+
+    if (lvl->switches.isEmpty())
+    {
+        lvl->switchData = false;
+        return;
+    }
+
+    lvl->switchData = true;
+
+    lvl->rawSwitchData.fill((quint8)0x00, 0x11 + 0x90);
+
+    int switchCount, objCount;
+    switchCount = lvl->switches.size();
+
+    if (switchCount > 8)
+    {
+        qWarning() << QString("Level %1: More than 8 switches found! Truncated to 8!").arg(id);
+        switchCount = 8;
+    }
+
+    for (int i = 0; i < switchCount; i++)
+    {
+        //switch state
+        lvl->rawSwitchData[i + 9] = lvl->switches.at(switchCount-i-1).state;
+        //switch address
+        lvl->rawSwitchData[17 + (i * 18)] = (quint8)(lvl->switches.at(switchCount-i-1).ramPos % 0x100);
+        lvl->rawSwitchData[17 + (i * 18) + 1] = (quint8)(lvl->switches.at(switchCount-i-1).ramPos / 0x100);
+
+        objCount = lvl->switches.at(switchCount-i-1).connectedTo.size();
+        if (objCount > 8)
+        {
+            qWarning() << QString("Level %1: More than 8 connected objects for switch %2! Truncated to 8!").arg(id).arg(switchCount-i-1);
+            objCount = 8;
+        }
+
+        for (int j = 0; j < objCount; j++)
+        {
+            //object addresses
+            lvl->rawSwitchData[17 + (i * 18) + (2*j) + 2] = (quint8)(lvl->switches.at(switchCount-i-1).connectedTo.at(objCount-j-1).ramPos % 0x100);
+            lvl->rawSwitchData[17 + (i * 18) + (2*j) + 3] = (quint8)(lvl->switches.at(switchCount-i-1).connectedTo.at(objCount-j-1).ramPos / 0x100);
+        }
+        //object use flag
+        lvl->rawSwitchData[i + 1] = (1 << lvl->switches.at(switchCount-i-1).connectedTo.size()) - 1;
+    }
+    //switch use flag
+    lvl->rawSwitchData[0] = (1 << lvl->switches.size()) - 1;
+}
+
+void QDKRom::rebuildAddSpriteData(int id)
+{
+    QDKLevel *lvl = &levels[id];
+
+    lvl->rawAddSpriteData.clear();
+    lvl->rawAddSpriteData.fill((quint8)0x00, 0x40);
+    lvl->addSpriteData = true;
+
+    int flagCount = 0;
+
+    for (int i = lvl->sprites.size() - 1; i >= 0; i--)
+    {
+        if (lvl->sprites.at(i).flagByte != getSpriteDefaultFlag(lvl->sprites.at(i).id))
+        {
+            if (flagCount >= 0x20)
+            {
+                qWarning() << QString("Level %1: More than 32 sprites with initialized flag byte! Truncated to 32!").arg(id);
+                break;
+            }
+
+            //check for elevator in tilemap
+            if ((lvl->sprites.at(i).id == 0x70) || (lvl->sprites.at(i).id == 0x72))
+                if (rawTileAt(lvl->tilemap, lvl->sprites.at(i).levelPos) != lvl->sprites.at(i).id)
+                    continue;
+
+            //IdLo HiFb
+            lvl->rawAddSpriteData[flagCount * 4] = (quint8)lvl->sprites.at(i).id;
+            lvl->rawAddSpriteData[flagCount * 4 + 1] = (quint8)(lvl->sprites.at(i).ramPos % 0x100);
+            lvl->rawAddSpriteData[flagCount * 4 + 2] = (quint8)(lvl->sprites.at(i).ramPos / 0x100);
+            lvl->rawAddSpriteData[flagCount * 4 + 3] = (quint8)lvl->sprites.at(i).flagByte;
+
+            flagCount++;
+        }
+    }
+
+    if (!flagCount)
+    {
+        lvl->rawAddSpriteData.clear();
+        lvl->addSpriteData = false;
+    }
+}
+
+bool QDKRom::recompressLevel(quint8 id)
+{
+    QDKLevel *lvl = &levels[id];
+    quint8 byte;
+    quint8 count;
+
+    if (lvl->fullDataUpToDate)
+        return true;
+
+    //rebuild sprite properties aka additional sprite data
+    rebuildAddSpriteData(id);
+
+    //rebuild switch connections
+    rebuildSwitchData(id);
+
+    // delete old data
+    lvl->fullData.clear();
+
+    // simple values
+    lvl->fullData.append(lvl->size);
+    lvl->fullData.append(lvl->music);
+    lvl->fullData.append(lvl->tileset);
+    byte = lvl->time % 0x100;
+    lvl->fullData.append(byte);
+    byte = lvl->time / 0x100;
+    lvl->fullData.append(byte);
+
+    // switch data
+    if (!lvl->switchData)
+        lvl->fullData.append(QChar(0x00));
+    else
+    {
+        count = 0;
+        byte = 0;
+
+        // copy the first 0x11 bytes uncompressed
+        for (int i = 0; i < 0x11; i++)
+            lvl->fullData.append((quint8)lvl->rawSwitchData[i]);
+
+        for (int i = 0x11; i < lvl->rawSwitchData.size(); i++) //compress the remaining bytes
+        {
+            count = 0;
+
+            while (((quint8)lvl->rawSwitchData[i] == (quint8)0x00) && (count < 0x7F) && (i < lvl->rawSwitchData.size()))
+            {
+                count++;
+                i++;
+            }
+
+            if (count != 0)
+            {
+                lvl->fullData.append(count);
+                count = 0;
+                i--;
+                continue;
+            }
+
+            while (((quint8)lvl->rawSwitchData[i] != (quint8)0x00) && (count < 0x7F) && (i < lvl->rawSwitchData.size()))
+            {
+                count++;
+                i++;
+            }
+
+            if (count != 0)
+            {
+                byte = 0x80 + count;
+                lvl->fullData.append(byte);
+                i--;
+
+                for (int j = 0; j < count; j++)
+                    lvl->fullData.append((quint8)lvl->rawSwitchData[i-count+1+j]);
+
+                count = 0;
+            }
+
+        }
+        if (count != 0)
+            qWarning() << QString("Level %1: recompressing switch data; count == %2").arg(id).arg(count);
+    }
+
+
+
+    if (!lvl->addSpriteData)
+        lvl->fullData.append(QChar(0x00));
+    else // compress additional sprite data (same as above)
+    {
+        count = 0;
+        byte = 0;
+
+        for (int i = 0; i < lvl->rawAddSpriteData.size(); i++)
+        {
+            count = 0;
+
+            while (((quint8)lvl->rawAddSpriteData[i] == (quint8)0x00) && (count < 0x7F) && (i < lvl->rawAddSpriteData.size()))
+            {
+                count++;
+                i++;
+            }
+
+            if (count != 0)
+            {
+                lvl->fullData.append(count);
+                count = 0;
+                i--;
+                continue;
+            }
+
+            while (((quint8)lvl->rawAddSpriteData[i] != (quint8)0x00) && (count < 0x7F) && (i < lvl->rawAddSpriteData.size()))
+            {
+                count++;
+                i++;
+            }
+
+            if (count != 0)
+            {
+                byte = 0x80 + count;
+                lvl->fullData.append(byte);
+                i--;
+
+                for (int j = 0; j < count; j++)
+                    lvl->fullData.append((quint8)lvl->rawAddSpriteData[i-count+1+j]);
+
+                count = 0;
+            }
+        }
+        if (count != 0)
+            qWarning() << QString("Level %1: recompressing sprite flag; count == %2").arg(id).arg(count);
+    }
+
+    // compress tilemap, 16bit tiles dropped
+    QByteArray raw = rawTilemap(lvl->tilemap);
+    lvl->fullData.append(LZSSCompress(&raw));
+
+    // add sprite tiles+ram position
+    for (int i = 0; i < lvl->sprites.size(); i++)
+    {
+        // do not add the pseudo elevator sprite
+        if ((lvl->sprites.at(i).id == 0x70) || (lvl->sprites.at(i).id == 0x72))
+            continue;
+
+        lvl->fullData.append((quint8)lvl->sprites.at(i).id);
+        byte = lvl->sprites.at(i).ramPos % 0x100;
+        lvl->fullData.append(byte);
+        byte = lvl->sprites.at(i).ramPos / 0x100;
+        lvl->fullData.append(byte);
+    }
+
+    // 0x00 marks level end
+    lvl->fullData.append(QChar(0x00));
+
+    lvl->fullDataUpToDate = true;
+
+    /*QFile file("recompessed.lvl");
+    file.open(QIODevice::WriteOnly);
+    file.write(lvl->fullData);
+    file.close();*/
+
+    return true;
+}
+
+QByteArray QDKRom::expandTilemap(const QByteArray &raw) const
+{
+    int cellCount = raw.size();
+    int height = cellCount / 0x20;
+    QByteArray tilemap(cellCount * 2, 0x00);
+    char *cells = tilemap.data();
+
+    //expand to 16bit for additional tiles
+    for (int i = 0; i < cellCount; i++)
+        cells[i*2] = raw.at(i);
+
+    quint8 tileID;
+    quint16 tilePos;
+
+    // expand super tiles, parts outside the level are dropped
+    for (int i = 0; i < cellCount; i++)
+    {
+        tileID = raw.at(i);
+        if ((tileID == 0xFF) || (tiles[tileID].count <= 1))
+            continue;
+
+        for (int j = 0; j < tiles[tileID].h; j++)
+            for (int k = 0; k < tiles[tileID].w; k++)
+            {
+                if ((!k && !j) || ((i % 0x20) + k >= 0x20) || ((i / 0x20) + j >= height))
+                    continue;
+
+                tilePos = 0x100 + tiles[tileID].additionalTilesAt + (j * tiles[tileID].w + k - 1);
+                cells[(i+k+(j*0x20))*2] = (tilePos & 0xFF);
+                cells[(i+k+(j*0x20))*2 + 1] = (tilePos >> 8);
+            }
+    }
+
+    return tilemap;
+}
+
+QByteArray QDKRom::rawTilemap(const QByteArray &tilemap)
+{
+    int cellCount = tilemap.size() / 2;
+    QByteArray raw(cellCount, 0x00);
+    const char *cells = tilemap.constData();
+    char *dst = raw.data();
+
+    // drop 16bit tiles
+    for (int i = 0; i < cellCount; i++)
+        dst[i] = cells[i*2 + 1] ? (char)0xFF : cells[i*2];
+
+    return raw;
+}
+
+quint8 QDKRom::rawTileAt(const QByteArray &tilemap, int cell)
+{
+    if ((cell < 0) || (cell * 2 + 1 >= tilemap.size()))
+        return 0xFF;
+
+    if (tilemap.at(cell*2 + 1))
+        return 0xFF;
+
+    return tilemap.at(cell*2);
+}
+
+quint32 QDKRom::tileDataOffset(QIODevice *src, quint8 tileID, quint8 tileSetID)
+{
+    quint16 pointer;
+    quint8 firstSet, secondSet;
+    quint32 offset = tiles[tileID].romOffset;
+
+    if (!tiles[tileID].setSpecific)
+        return offset;
+
+    QDataStream tmp(src);
+
+    // get the two sub tilesets offsets
+    // rombank 0xC offset 0x4EEB is a table of two offsets for every tileset
+    tmp.setByteOrder(QDataStream::LittleEndian);
+    src->seek(SUBTILESET_TABLE + (tileSetID*2));
+
+    tmp >> firstSet;
+    tmp >> secondSet;
+
+    // this is finally the last pointer before the actual tile data...
+    // here are the "same" tiles from different tilesets grouped together
+    if ((tileID < 0xCD) || (tileID == 0xFD))
+        src->seek(offset + firstSet);
+    else
+        src->seek(offset + secondSet);
+
+    tmp >> pointer;
+
+    return offset + pointer;
+}
+
+bool QDKRom::getTileInfo(QIODevice *src)
+{
+    QDKTraceScope trace("getTileInfo");
+
+    QDataStream in(src);
+    in.setByteOrder(QDataStream::LittleEndian);
+
+    quint16 pointer;
+    quint8 bank, tilesCount;
+    quint32 offset;
+    quint16 addOffset = 0;
+    quint8 byte;
+
+    for (int i = 0; i < 255; i++)
+    {
+        // rombank 0x01 offset 0x60E5 is a table with pointers for all tiles
+        src->seek(TILE_INDEX_TABLE + 2*i);
+        in >> pointer;
+
+        tiles[i].setSpecific = false;
+        tiles[i].romOffset = 0;
+        tiles[i].additionalTilesAt = 0;
+        tiles[i].type = 0;
+        tiles[i].projectileTileCount = 0;
+        tilesCount = 0;
+
+        // the pointer points to some meta data for every "tile"
+        // like tiles count and size of "super tiles"
+
+        if (isSprite[i] && (i != 0x54))
+        {
+            // at last try pointer+3 for sprite tiles like DK and Mario
+            // the game code checks these tiles earlier but my code
+            // corrupts some tiles like 0x41 the plant in level 14
+            src->seek(pointer+3);
+            in >> tilesCount;
+            tiles[i].type = 3;
+        }
+
+        if (tilesCount == 0)
+        {
+            // first try pointer+4 for count
+            src->seek(pointer+4);
+            in >> tilesCount;
+            tiles[i].type = 4;
+        }
+
+        if (tilesCount == 0)
+        {
+            // next try pointer+5 for count
+            src->seek(pointer+5);
+            in >> tilesCount;
+            tiles[i].type = 5;
+        }
+        if (tilesCount == 0)
+        {
+            // the tiles count includes "animations"
+            src->seek(pointer+2);
+            in >> tilesCount;
+            tiles[i].type = 2;
+
+            // check for projectile sprites
+            // sum values from pointer+3 and pointer+13
+            if (tilesCount != 0)
+            {
+                in >> byte;
+                if (byte)
+                {
+                    tiles[i].projectileTileCount = byte;
+                    src->seek(pointer+13);
+                    in >> byte;
+                    tiles[i].projectileTileCount += byte;
+                }
+            }
+
+            // another exception...
+            if ((i == 0x9A) || (i == 0x8A) || (i == 0x9D) || (i == 0x9E) || (i == 0x54) || (i == 0x43) || (i == 0x79) || (i == 0xAF) || (i == 0x53) || (i == 0x65))
+            {
+                src->seek(pointer+0xD);
+                in >> byte;
+                if (byte >= tilesCount)
+                    tilesCount = byte;
+                //else
+                //    tilesCount -= byte;
+                // this results in wrong tilesCount for umbrella etc.
+                // but is need for compression check; fix see below
+            }
+        }
+
+        if (tilesCount == 0)
+        {
+            // check again...
+            src->seek(pointer+3);
+            in >> tilesCount;
+            tiles[i].type = 3;
+        }
+
+        // which tiles are compressed and which are not? if tilesCount >= 4 ???
+        tiles[i].compressed = (tilesCount >= 4);
+
+        // exception for these tiles (see above)
+        if ((i == 0x9A) || (i == 0x8A) || (i == 0x9D) || (i == 0x9E) || (i == 0x54) || (i == 0x43) || (i == 0x79) || (i == 0xAF) || (i == 0x53) || (i == 0x65))
+            tiles[i].compressed = ((tilesCount - byte) >= 4);
+
+        // get data needed for super tiles
+        //tiles[i].count = tilesCount;
+        src->seek(pointer+8);
+        in >> tiles[i].h;
+        in >> tiles[i].w;
+        tiles[i].count = tiles[i].h * tiles[i].w; // just get enough tiles to display the full super tile - no animations
+        tiles[i].fullCount = tilesCount;
+
+        if (tiles[i].count == 0)
+            continue;
+
+        if (tiles[i].count > 1)
+        {
+            tiles[i].additionalTilesAt = addOffset;
+            addOffset += (tiles[i].count - 1);
+        }
+
+        if (i == 0x8A)
+        {
+            tiles[i].h = 4;
+        }
+
+        if (i == 0x8E)
+        {
+            tiles[i].h = 2;
+            tiles[i].w = 2;
+        }
+
+        src->seek(pointer+6);
+        in >> pointer;
+        // and another pointer which either points to a rombank | pointer table
+        // or directly to the (compressed) tile data
+
+        // why should everything be nicely order in a rom bank | pointer table ?
+        // that would be too easy -- maybe it is <= instead of <
+        if (pointer < 0x7E00)
+        {
+            if (i < 0x80)
+                offset = 0xD*0x4000 + pointer;
+            else if (i < 0xAF)
+                offset = 0xC*0x4000 + pointer;
+            else
+                offset = 0x1B*0x4000 + pointer;
+
+            tiles[i].romOffset = offset;
+
+            // quick hack to get the right offset for the mario sprite
+            if (i == 0x7F)
+            {
+                tiles[i].romOffset = 0x106F0;
+                tiles[i].fullCount = 0x50;
+            }
+
+            continue;
+        }
+
+        src->seek(0xd*0x4000 + pointer);
+        in >> bank;
+        in >> pointer;
+
+
+        offset = (bank-1)*0x4000 + pointer;
+
+        tiles[i].setSpecific = true;
+        tiles[i].romOffset = offset;
+    }
+
+    tiles[0xFF].fullCount = 1;
+    tiles[0xFF].w = 1;
+    tiles[0xFF].h = 1;
+    tiles[0xFF].count = 1;
+    tiles[0xFF].compressed = false;
+
+    tiles[0x54].fullCount = 4;
+
+    // get supporting tiles from table @ ADDITIONAL_TILES_TABLE
+    quint8 count;
+    quint8 tile;
+
+    src->seek(ADDITIONAL_TILES_TABLE);
+    in >> count;
+    while (count != (quint8)0xFF)
+    {
+        in >> tile;
+        for (int i = 0; i < count; i++)
+        {
+            in >> byte;
+            tiles[tile].needsTiles.append(byte);
+        }
+        in >> count;
+    }
+
+    return true;
+}
+
+int QDKRom::replaceTile(QDKLevel *level, quint8 from, quint8 to, int *skipped) const
+{
+    *skipped = 0;
+
+    if ((from == to) || level->tilemap.isEmpty())
+        return 0;
+
+    // the tilemap is 16 bit, 0x20 cells wide
+    int cellCount = level->tilemap.size() / 2;
+    int height = cellCount / 0x20;
+    const uchar *cells = (const uchar *)level->tilemap.constData();
+
+    // cells covered by any tile, empty cells are 0xFF 0x00
+    QVector<bool> used(cellCount);
+    for (int i = 0; i < cellCount; i++)
+        used[i] = (cells[i*2] != 0xFF) || (cells[i*2 + 1] != 0x00);
+
+    QByteArray display = level->tilemap;
+    int oldW = tiles[from].w, oldH = tiles[from].h;
+    int newW = tiles[to].w, newH = tiles[to].h;
+    bool oldSuper = tiles[from].count > 1;
+    bool newSuper = tiles[to].count > 1;
+    int replaced = 0;
+    int x, y, j, k;
+    bool fits;
+
+    for (int i = 0; i < cellCount; i++)
+    {
+        if (((quint8)display.at(i*2) != from) || ((quint8)display.at(i*2 + 1) != 0x00))
+            continue;
+
+        x = i % 0x20;
+        y = i / 0x20;
+
+        // the new footprint may only take empty cells or the ones of the old tile
+        fits = !newSuper || ((x + newW <= 0x20) && (y + newH <= height));
+        for (j = 0; fits && newSuper && (j < newH); j++)
+            for (k = 0; fits && (k < newW); k++)
+                fits = !used.at(i + k + j*0x20) || (oldSuper && (k < oldW) && (j < oldH)) || (!k && !j);
+
+        if (!fits)
+        {
+            (*skipped)++;
+            continue;
+        }
+
+        if (oldSuper)
+            for (j = 0; j < oldH; j++)
+                for (k = 0; k < oldW; k++)
+                {
+                    if ((x + k >= 0x20) || (y + j >= height))
+                        continue;
+
+                    display[(i+k+(j*0x20))*2] = (char)0xFF;
+                    display[(i+k+(j*0x20))*2 + 1] = 0x00;
+                    used[i+k+(j*0x20)] = false;
+                }
+
+        display[i*2] = to;
+        display[i*2 + 1] = 0x00;
+        used[i] = true;
+
+        // same expansion as expandTilemap
+        if (newSuper)
+        {
+            quint16 tilePos = 0x100 + tiles[to].additionalTilesAt;
+
+            for (j = 0; j < newH; j++)
+                for (k = 0; k < newW; k++)
+                {
+                    if (!k && !j)
+                        continue;
+
+                    display[(i+k+(j*0x20))*2] = (tilePos & 0xFF);
+                    display[(i+k+(j*0x20))*2 + 1] = (tilePos >> 8);
+                    used[i+k+(j*0x20)] = true;
+                    tilePos++;
+                }
+        }
+
+        replaced++;
+    }
+
+    if (!replaced)
+        return 0;
+
+    level->tilemap = display;
+    level->fullDataUpToDate = false;
+
+    return replaced;
+}
+
+int QDKRom::replaceSprite(QDKLevel *level, quint8 from, quint8 to) const
+{
+    if ((from == to) || !isSprite[to])
+        return 0;
+
+    int replaced = 0;
+
+    for (int i = 0; i < level->sprites.size(); i++)
+    {
+        if (level->sprites.at(i).id != from)
+            continue;
+
+        // the flag byte means something else for every sprite
+        level->sprites[i].id = to;
+        level->sprites[i].size = QSize(tiles[to].w, tiles[to].h);
+        level->sprites[i].flagByte = getSpriteDefaultFlag(to);
+        level->sprites[i].drawOffset = QPointF((to == 0x54) ? -0.5f : 0.0f, 0.0f);
+        replaced++;
+    }
+
+    if (replaced)
+        level->fullDataUpToDate = false;
+
+    return replaced;
+}
+
+void QDKRom::levelMemoryUsage(QDKMemoryReport *report) const
+{
+    qint64 tilemaps, data, switches, sprites;
+
+    for (int i = 0; i < MAX_LEVEL_ID; i++)
+    {
+        const QDKLevel *lvl = &levels[i];
+
+        tilemaps = lvl->tilemap.capacity();
+        data = lvl->fullData.capacity();
+
+        switches = lvl->rawSwitchData.capacity() + lvl->switches.size() * sizeof(QDKSwitch);
+        for (int j = 0; j < lvl->switches.size(); j++)
+            switches += lvl->switches.at(j).connectedTo.size() * sizeof(QDKSwitchObject);
+
+        sprites = lvl->rawAddSpriteData.capacity() + lvl->sprites.size() * sizeof(QDKSprite);
+
+        report->categories["levels: tilemaps"] += tilemaps;
+        report->categories["levels: compressed data"] += data;
+        report->categories["levels: switches"] += switches;
+        report->categories["levels: sprites"] += sprites;
+        report->levels[i] = tilemaps + data + switches + sprites;
+    }
+}
+
+QByteArray QDKRom::LZSSDecompress(QDataStream *in, quint16 decompressedSize)
+{
+    in->setByteOrder(QDataStream::LittleEndian);
+
+    QByteArray decompressed;
+
+    quint8 byte, flags, len, byte2;
+    quint16 start;
+    quint32 offset;
+
+    while (decompressed.size() < decompressedSize)
+    {
+        (*in) >> flags;
+
+        for (int i = 0; i < 8; i++)
+        {
+            if (flags & 0x1) // raw data
+            {
+                (*in) >> byte;
+                decompressed.append(byte);
+            }
+            else // copy data
+            {
+                (*in) >> byte;
+                (*in) >> len;
+
+                //start is actually 12bit and length only 4bit
+                byte2 = len;
+                start = (quint16)byte + (0x100 * ((quint16)len / 0x10));
+                len = len % 0x10;
+
+                len += 3;
+                if (start == 0)
+                {
+                    qWarning() << QString("LZSSDecompress: something went wrong; start = 0");
+                    //qDebug() << decompressedSize << decompressed.size() << byte << byte2 << len;
+                    return decompressed;
+                }
+                offset = decompressed.size() - start;
+                //qDebug() << "start " << start << " length " << len;
+
+                for (int j = 0; j < len; j++)
+                    decompressed.append((quint8)decompressed.at(offset+j));
+            }
+
+            flags >>= 1;
+
+            if (decompressed.size() >= decompressedSize)
+                break;
+        }
+    }
+
+    return decompressed;
+}
+
+QByteArray QDKRom::LZSSCompress(QByteArray *src)
+{
+    QByteArray compressed;
+    quint8 flagByte, flagBit, byte;
+    qint32 srcPos, flagBytePos, matchLength, matchRelativePos, currentMatchLength, j, matchEnd;
+
+    flagByte = 0x1;
+    flagBytePos = 0;
+    flagBit = 0x2;
+    srcPos = 0;
+
+    // add first flag byte (place holder) and add first raw data byte
+    compressed.append(flagByte);
+    compressed.append((quint8)src->at(srcPos++));
+
+    while (srcPos < src->size())
+    {
+        // find match in previous data
+
+        // start max 4096 bytes back from current pos
+        if (srcPos <= 4096)
+            matchEnd = 0;
+        else
+            matchEnd = srcPos - 4096;
+
+        matchLength = 0;
+
+        // try from current position
+        //for (int i = matchEnd; i < srcPos; i++)
+        for (int i = srcPos-1; i >= matchEnd; i--)
+        {
+            // start compare for every i
+            j = 0;
+            while ((*src)[i+j] == (*src)[srcPos+j])
+            {
+                j++;
+                // make sure to stay inside 4 bits (+3) and inside byte array
+                if ((j >= 18) || (i+j >= src->size()) || (srcPos+j >= src->size()))
+                    break;
+            }
+
+            // remember best match
+            currentMatchLength = j;
+            if (matchLength < currentMatchLength)
+            {
+                matchLength = currentMatchLength;
+                matchRelativePos = (srcPos - i);
+            }
+
+            // no point in looking further if this is max length
+            if (currentMatchLength == 18)
+                break;
+        }
+
+        // check if it is long enough
+        if (matchLength < 3) // too short
+        {
+            flagByte |= flagBit; // raw data - not compressed
+            compressed.append((quint8)src->at(srcPos++)); // add raw data byte
+        }
+        else
+        {
+            // nothing to do with the flag byte
+
+            // move srcPos after length
+            srcPos += matchLength;
+
+            // adjust length
+            matchLength -= 3;
+
+            // add relative start and length to copy
+            if (matchRelativePos > 255)
+            {
+                byte = matchRelativePos % 0x100;
+                compressed.append(byte);
+                byte = matchLength + (0x10 * (matchRelativePos / 0x100));
+                compressed.append(byte);
+            }
+            else
+            {
+                compressed.append((quint8)matchRelativePos);
+                compressed.append((quint8)matchLength);
+            }
+        }
+
+        if (flagBit == 0x80) // flag byte fully populated
+        {
+            compressed[flagBytePos] = flagByte; // write correct flag byte back to original position
+
+            // reset flag byte and counter bit
+            flagByte = 0;
+            flagBit = 0x1;
+
+            // save new flag byte position
+            flagBytePos = compressed.size();
+
+            if (srcPos < src->size()) // make sure there is more data
+                compressed.append((quint8)0x1D); // place holder for flag byte
+        }
+        else // shift flag bit
+            flagBit <<= 1;
+    }
+
+    // write back last incomplete flag byte
+    if (flagBit != 1)
+        compressed[flagBytePos] = flagByte;
+
+    return compressed;
+}
+
+quint8 QDKRom::getSpriteDefaultFlag(int id)
+{
+    switch (id)
+    {
+        case 0x80: case 0x98: return 0x03; // walking friend+enemy
+        case 0x70: case 0x72: return 0x05; // elevator up/down
+        case 0x54: case 0x84: return 0x00;
+        case 0x7F:            return 0x00; // Mario
+        case 0xB8:            return 0xFF; // key/hole 0/1 ? WTF?!
+        //different DKs
+        /*set in game: 6E 00
+                       9A 01 00
+                       CC 01
+                       B8 00 01 */
+        case 0x6E: return 0xFF; // probably 0x00                               // Lvl0-1, 9-5 barrels
+        case 0x9A: return 0xFF; // even more guessed 0x00                      // Lvl1-4, 5-4, 7-8, 9-1 avalanche
+        case 0xCC: return 0xFF; // this one at least is never set explicitly   // Lvl1-8, 2-12, 3-8, 6-8, 7-12 pick-up barrels
+        default: return 0x00;
+    }
+}
+
+QVector<quint16> QDKRom::tileCounts(const QByteArray &tilemap)
+{
+    QVector<quint16> counts(256);
+    const uchar *cells = (const uchar *)tilemap.constData();
+
+    for (int i = 0; i + 1 < tilemap.size(); i+=2)
+        if (cells[i+1] == 0x00)
+            counts[cells[i]]++;
+
+    return counts;
+}
+
+void QDKRom::countVRAMusage(const QByteArray &tilemap, const QVector<int> &spriteIDs, quint16 *tileCount, quint16 *spriteCount)
+{
+    countVRAMusage(tileCounts(tilemap), spriteIDs, tileCount, spriteCount);
+}
+
+void QDKRom::countVRAMusage(const QVector<quint16> &cellCounts, const QVector<int> &spriteIDs, quint16 *tileCount, quint16 *spriteCount)
+{
+    *tileCount = 0;
+    *spriteCount = 0;
+
+    bool elevator = false;
+    QSet<quint8> neededTiles;
+
+    // max tiles seems to be 80
+    // uses sprite space if too many tiles and sprite space still empty
+
+    // empty tile is omit on purpose
+
+    for (int i = 0; i < 255; i++)
+    {
+        if (!cellCounts.at(i))
+            continue;
+
+        // key, exit, fake exit, expandle ground/ladder, placeable block/spring, super hammer
+        // count as "sprites" - earliest VRAM pos seems to be 0x8800
+        // this may results in unused tiles before 0x8800 in VRAM
+        quint16 *count = tileCount;
+        if ((i == 0x79) || (i == 0x9E) || (i == 0x4B) || (i == 0xBB) ||
+            (i == 0xBC) || (i == 0x75) || (i == 0x77) || (i == 0xC4))
+            count = spriteCount;
+
+        *count += tiles[i].fullCount;
+
+        // elevator ids after the first one are counted for every cell holding them
+        if (elevator && ((i == 0x70) || (i == 0x71) || (i == 0x72) || (i == 0x73)))
+        {
+            *count += tiles[i].fullCount * (cellCounts.at(i) - 1);
+            continue;
+        }
+
+        if ((i == 0x70) || (i == 0x71) || (i == 0x72) || (i == 0x73))
+            elevator = true;
+
+        if (!tiles[i].needsTiles.isEmpty())
+            for (int t = 0; t < tiles[i].needsTiles.size(); t++)
+                neededTiles << tiles[i].needsTiles.at(t);
+
+        if (tiles[i].projectileTileCount)
+            *spriteCount += tiles[i].projectileTileCount;
+    }
+
+    // max sprites seems to be 0x100
+    for (int i = 0; i < 255; i++)
+        for (int j = 0; j < spriteIDs.size(); j++)
+            if (spriteIDs.at(j) == i)
+            {
+                // skip my pseudo sprites for the elevator properties
+                if ((i == 0x70) || (i == 0x72))
+                    continue;
+
+                *spriteCount += tiles[i].fullCount;
+
+                if (!tiles[i].needsTiles.isEmpty())
+                    for (int t = 0; t < tiles[i].needsTiles.size(); t++)
+                        *spriteCount += tiles[tiles[i].needsTiles.at(t)].fullCount;
+
+                break;
+            }
+
+    QSet<quint8>::iterator i;
+    for (i = neededTiles.begin(); i != neededTiles.end(); ++i)
+        *spriteCount += tiles[*i].fullCount;
+}
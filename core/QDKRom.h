@@ -0,0 +1,174 @@
+#ifndef QDKROM_H
+#define QDKROM_H
+
+#include "QSprite.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QIODevice>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+//find rombanks containing the level data
+#define ROMBANK_1 0x05
+#define COMPARE_POS_1 0x25FC  // < 0x2D
+
+#define ROMBANK_POS_2 0x25FF  // 0x06
+#define COMPARE_POS_2 0x2603  // < 0x50
+
+#define ROMBANK_POS_3 0x2606  // 0x12
+
+// some constants
+#define MAX_LEVEL_ID 256
+#define LAST_LEVEL 105
+#define MAX_TILESETS 0x22
+#define MAX_SPRITES 0x1B
+#define POINTER_TABLE 0x14000
+#define SUBTILESET_TABLE 0x30EEB
+#define SGB_SYSTEM_PAL 0x786F0 // decompressed size 0x1000
+// the SGB packet is always 51.(quint16)var+0x80.E4 00.E5.00.E6 00.C1.00.00 00.00.00.00
+// asm @ 0x0E70
+#define PAL_ARCADE 0x30F9A
+// the palette for the 4 arcade levels are @ 0x4F9A (bank 0x0C) + (6*id)
+// this value is palette index + 0xC8
+// not freely editable!
+#define PAL_TABLE 0x6093B
+// PAL_TABLE + (id-4)*8
+// palettes for all other levels
+
+// BGP depends on tileset asm @ 0E9D
+#define TILE_INDEX_TABLE 0x60E5
+#define ADDITIONAL_TILES_TABLE 0x30E55
+
+#define VRAM_TILES 0x50
+#define VRAM_SPRITES 0x100
+
+#define ELEVATOR_TABLE 0x30F77
+
+struct QDKSprite : QSprite
+{
+    quint16 ramPos;
+    quint32 levelPos;
+//    quint8 addFlag;
+};
+
+struct QDKSwitchObject
+{
+    quint8 x, y;
+    quint16 ramPos;
+    quint32 levelPos;
+    bool isSprite;
+};
+
+struct QDKSwitch
+{
+    quint8 state;
+    quint8 x, y;
+    quint32 levelPos;
+    quint16 ramPos;
+    QList<QDKSwitchObject> connectedTo;
+};
+
+struct QDKLevel
+{
+    quint8 id; // max 256 !
+    quint8 rombank;
+    quint32 offset;
+
+    quint8 size; // 0x00 -> 0x240 bytes for tilemap else 0x380 bytes
+    quint8 music;
+    quint8 tileset;
+    quint16 time;
+
+    bool switchData;
+    bool addSpriteData;
+    bool fullDataUpToDate;
+
+    // the only stored tilemap: one 16 bit cell (lo, hi) per tile, 0x20 cells wide
+    // cells above 0xFF are super tile parts, the rom's 8 bit form is derived from it
+    QByteArray tilemap;
+    quint16 paletteIndex;
+
+    QList<QDKSprite> sprites;
+    QList<QDKSwitch> switches;
+
+    QByteArray rawSwitchData; // 0x11 + 0x90 bytes
+    QByteArray rawAddSpriteData; // 0x40 bytes
+
+    QByteArray fullData;
+};
+
+struct QTileInfo
+{
+    quint8 w, h;
+    quint8 type; // that's a bit vague - this is the pointer+N value
+    quint8 count;
+    quint8 fullCount;
+    quint8 setSpecific;
+    quint16 additionalTilesAt;
+    quint32 romOffset;
+    QList<int> needsTiles;
+    quint8 projectileTileCount;
+    bool compressed;
+};
+
+// approximate bytes held in memory, implicitly shared data is counted for every holder
+struct QDKMemoryReport
+{
+    QMap<QString, qint64> categories;
+    qint64 levels[MAX_LEVEL_ID];
+};
+
+// rom and level data without any widgets
+// everything reads from and writes to QIODevices
+class QDKRom
+{
+public:
+    QDKRom();
+
+    bool readAllLevels(QIODevice *rom);
+    bool writeAllLevels(QIODevice *rom);
+    bool readLevel(QIODevice *src, quint8 id, bool fromLvlFile = false);
+    bool recompressLevel(quint8 id);
+    bool exportLevel(quint8 id, QIODevice *dst);
+    bool importLevel(quint8 id, QIODevice *src);
+
+    bool getTileInfo(QIODevice *src);
+    bool readSGBPalettes(QIODevice *src);
+    quint32 tileDataOffset(QIODevice *src, quint8 tileID, quint8 tileSetID);
+
+    // tiles and sprite tiles the level needs in VRAM
+    void countVRAMusage(const QByteArray &tilemap, const QVector<int> &spriteIDs, quint16 *tileCount, quint16 *spriteCount);
+    void countVRAMusage(const QVector<quint16> &cellCounts, const QVector<int> &spriteIDs, quint16 *tileCount, quint16 *spriteCount);
+    static QVector<quint16> tileCounts(const QByteArray &tilemap); // cells per tile id, super tile parts left out
+
+    // replace an id in a copy of a level, super tiles only where their footprint is free
+    // returns the number of replaced tiles/sprites, tiles that don't fit are counted in *skipped
+    int replaceTile(QDKLevel *level, quint8 from, quint8 to, int *skipped) const;
+    int replaceSprite(QDKLevel *level, quint8 from, quint8 to) const;
+
+    // fills the level categories and the per level sums
+    void levelMemoryUsage(QDKMemoryReport *report) const;
+
+    // 8 bit rom tilemap <-> 16 bit level tilemap
+    QByteArray expandTilemap(const QByteArray &raw) const;
+    static QByteArray rawTilemap(const QByteArray &tilemap);
+    static quint8 rawTileAt(const QByteArray &tilemap, int cell);
+
+    static QByteArray LZSSDecompress(QDataStream *in, quint16 decompressedSize);
+    static QByteArray LZSSCompress(QByteArray *src);
+    static quint8 getSpriteDefaultFlag(int id);
+
+    QDKLevel levels[MAX_LEVEL_ID];
+    QTileInfo tiles[256];
+    quint16 sgbPalettes[512][4]; // BGR555 as stored in the rom
+    static bool isSprite[256];
+
+protected:
+    void rebuildAddSpriteData(int id);
+    void rebuildSwitchData(int id);
+};
+
+#endif // QDKROM_H
@@ -0,0 +1,92 @@
+#include "QDKTrace.h"
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QTextStream>
+
+bool QDKTrace::enabled = false;
+QString QDKTrace::filename;
+QElapsedTimer QDKTrace::timer;
+QMutex QDKTrace::mutex;
+QList<QDKTraceEvent> QDKTrace::events;
+QHash<Qt::HANDLE, int> QDKTrace::threads;
+
+void QDKTrace::enable(QString filename)
+{
+    QDKTrace::filename = filename;
+
+    // the thread enabling the trace is the GUI thread and gets id 0
+    threads.insert(QThread::currentThreadId(), 0);
+
+    timer.start();
+    enabled = true;
+}
+
+void QDKTrace::addEvent(const char *name, int id, qint64 start, qint64 duration)
+{
+    QMutexLocker locker(&mutex);
+
+    Qt::HANDLE handle = QThread::currentThreadId();
+    if (!threads.contains(handle))
+        threads.insert(handle, threads.size());
+
+    QDKTraceEvent event;
+    event.name = name;
+    event.id = id;
+    event.thread = threads.value(handle);
+    event.start = start;
+    event.duration = duration;
+    events.append(event);
+}
+
+bool QDKTrace::write()
+{
+    if (!enabled)
+        return true;
+
+    QMutexLocker locker(&mutex);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        qWarning() << QString("Could not write trace %1").arg(filename);
+        return false;
+    }
+
+    QTextStream out(&file);
+
+    // complete events ("X") with timestamps in microseconds
+    out << "{\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"GUI\"}}";
+
+    for (int i = 0; i < events.size(); i++)
+    {
+        const QDKTraceEvent &event = events.at(i);
+
+        out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"eDKit\",\"ph\":\"X\"";
+        out << ",\"ts\":" << QString::number(event.start / 1000.0, 'f', 3);
+        out << ",\"dur\":" << QString::number(event.duration / 1000.0, 'f', 3);
+        out << ",\"pid\":1,\"tid\":" << event.thread;
+        if (event.id >= 0)
+            out << ",\"args\":{\"id\":" << event.id << "}";
+        out << "}";
+    }
+
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    file.close();
+
+    return true;
+}
+
+QStringList QDKTrace::stripArguments(QStringList args)
+{
+    int i = args.indexOf(TRACE_ARGUMENT);
+    if (i < 0)
+        return args;
+
+    args.removeAt(i);
+    if (i < args.size())
+        args.removeAt(i);
+
+    return args;
+}
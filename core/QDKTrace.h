@@ -0,0 +1,62 @@
+#ifndef QDKTRACE_H
+#define QDKTRACE_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QMutex>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+
+// command line option: --trace <file> writes a Chrome trace (about:tracing / Perfetto)
+#define TRACE_ARGUMENT "--trace"
+
+struct QDKTraceEvent
+{
+    const char *name;
+    int id; // level, tileset etc. -1 for none
+    int thread;
+    qint64 start; // ns since the trace was enabled
+    qint64 duration;
+};
+
+class QDKTrace
+{
+public:
+    static void enable(QString filename);
+    static bool isEnabled() { return enabled; }
+    static qint64 now() { return timer.nsecsElapsed(); }
+    static void addEvent(const char *name, int id, qint64 start, qint64 duration);
+    static bool write();
+
+    // removes the trace option so only the other arguments are left
+    static QStringList stripArguments(QStringList args);
+
+private:
+    static bool enabled;
+    static QString filename;
+    static QElapsedTimer timer;
+    static QMutex mutex;
+    static QList<QDKTraceEvent> events;
+    static QHash<Qt::HANDLE, int> threads;
+};
+
+// records the time from construction until it goes out of scope
+class QDKTraceScope
+{
+public:
+    explicit QDKTraceScope(const char *name, int id = -1) :
+        name(name), id(id), start(QDKTrace::isEnabled() ? QDKTrace::now() : -1) {}
+    ~QDKTraceScope()
+    {
+        if (start >= 0)
+            QDKTrace::addEvent(name, id, start, QDKTrace::now() - start);
+    }
+
+private:
+    const char *name;
+    int id;
+    qint64 start;
+};
+
+#endif // QDKTRACE_H
@@ -0,0 +1,154 @@
+#include "QDKUsageIndex.h"
+
+// the tilemap is always 0x20 cells wide
+#define LEVEL_WIDTH 0x20
+
+QDKUsageIndex::QDKUsageIndex() :
+    tileCounts(256 * MAX_LEVEL_ID, 0), spriteCounts(256 * MAX_LEVEL_ID, 0)
+{
+}
+
+void QDKUsageIndex::clear()
+{
+    for (int i = 0; i < 256; i++)
+    {
+        tiles[i].clear();
+        sprites[i].clear();
+    }
+
+    tileCounts.fill(0);
+    spriteCounts.fill(0);
+}
+
+void QDKUsageIndex::build(const QDKRom *rom)
+{
+    clear();
+
+    QVector<QDKUsage> levelTiles[256];
+    QVector<QDKUsage> levelSprites[256];
+
+    // levels are scanned in order so every list ends up sorted by level
+    for (int id = 0; id < MAX_LEVEL_ID; id++)
+    {
+        scanLevel(rom->levels[id], id, levelTiles, levelSprites);
+
+        for (int i = 0; i < 256; i++)
+        {
+            tiles[i] += levelTiles[i];
+            tileCounts[i * MAX_LEVEL_ID + id] = levelTiles[i].size();
+            sprites[i] += levelSprites[i];
+            spriteCounts[i * MAX_LEVEL_ID + id] = levelSprites[i].size();
+        }
+    }
+}
+
+void QDKUsageIndex::updateLevel(const QDKRom *rom, int id)
+{
+    if ((id < 0) || (id >= MAX_LEVEL_ID))
+        return;
+
+    QVector<QDKUsage> levelTiles[256];
+    QVector<QDKUsage> levelSprites[256];
+    scanLevel(rom->levels[id], id, levelTiles, levelSprites);
+
+    // only the ids the level used before or uses now are touched
+    for (int i = 0; i < 256; i++)
+    {
+        if (tileCounts.at(i * MAX_LEVEL_ID + id) || !levelTiles[i].isEmpty())
+            replaceLevel(&tiles[i], &tileCounts, i, id, levelTiles[i]);
+        if (spriteCounts.at(i * MAX_LEVEL_ID + id) || !levelSprites[i].isEmpty())
+            replaceLevel(&sprites[i], &spriteCounts, i, id, levelSprites[i]);
+    }
+}
+
+void QDKUsageIndex::scanLevel(const QDKLevel &level, int id, QVector<QDKUsage> *levelTiles, QVector<QDKUsage> *levelSprites)
+{
+    for (int i = 0; i < 256; i++)
+    {
+        levelTiles[i].clear();
+        levelSprites[i].clear();
+    }
+
+    QDKUsage usage;
+    usage.level = id;
+
+    // 16 bit cells, values above 0xFF are parts of super tiles
+    const uchar *cells = (const uchar *)level.tilemap.constData();
+    int cellCount = level.tilemap.size() / 2;
+
+    for (int i = 0; i < cellCount; i++)
+    {
+        if (cells[i*2 + 1])
+            continue;
+
+        usage.x = i % LEVEL_WIDTH;
+        usage.y = i / LEVEL_WIDTH;
+        levelTiles[cells[i*2]].append(usage);
+    }
+
+    for (int i = 0; i < level.sprites.size(); i++)
+    {
+        usage.x = level.sprites.at(i).x;
+        usage.y = level.sprites.at(i).y;
+        levelSprites[level.sprites.at(i).id & 0xFF].append(usage);
+    }
+}
+
+void QDKUsageIndex::replaceLevel(QVector<QDKUsage> *list, QVector<quint16> *counts, int key, int id, const QVector<QDKUsage> &items)
+{
+    // binary search for the first entry of the level
+    int start = 0;
+    int end = list->size();
+    int mid;
+
+    while (start < end)
+    {
+        mid = (start + end) / 2;
+        if (list->at(mid).level < id)
+            start = mid + 1;
+        else
+            end = mid;
+    }
+
+    int count = counts->at(key * MAX_LEVEL_ID + id);
+
+    QVector<QDKUsage> merged;
+    merged.reserve(list->size() - count + items.size());
+    merged += list->mid(0, start);
+    merged += items;
+    merged += list->mid(start + count);
+    *list = merged;
+
+    (*counts)[key * MAX_LEVEL_ID + id] = items.size();
+}
+
+QList<int> QDKUsageIndex::levelsOf(const QVector<quint16> &counts, int key) const
+{
+    QList<int> levels;
+
+    for (int id = 0; id < MAX_LEVEL_ID; id++)
+        if (counts.at(key * MAX_LEVEL_ID + id))
+            levels.append(id);
+
+    return levels;
+}
+
+QList<int> QDKUsageIndex::tileLevels(quint8 tile) const
+{
+    return levelsOf(tileCounts, tile);
+}
+
+QList<int> QDKUsageIndex::spriteLevels(quint8 sprite) const
+{
+    return levelsOf(spriteCounts, sprite);
+}
+
+qint64 QDKUsageIndex::bytes() const
+{
+    qint64 bytes = (tileCounts.capacity() + spriteCounts.capacity()) * sizeof(quint16);
+
+    for (int i = 0; i < 256; i++)
+        bytes += (tiles[i].capacity() + sprites[i].capacity()) * sizeof(QDKUsage);
+
+    return bytes;
+}
@@ -0,0 +1,45 @@
+#ifndef QDKUSAGEINDEX_H
+#define QDKUSAGEINDEX_H
+
+#include <QtCore/QList>
+#include <QtCore/QVector>
+
+#include "QDKRom.h"
+
+// a cell or sprite of a level using an id
+struct QDKUsage
+{
+    quint8 level;
+    quint8 x, y;
+};
+
+// inverted index from tile and sprite ids to the levels and positions using them
+// built once after loading, single levels get reindexed when they are saved
+class QDKUsageIndex
+{
+public:
+    QDKUsageIndex();
+
+    void build(const QDKRom *rom);
+    void updateLevel(const QDKRom *rom, int id);
+    void clear();
+
+    // sorted by level, super tile parts are not listed
+    const QVector<QDKUsage> &tileUsage(quint8 tile) const { return tiles[tile]; }
+    const QVector<QDKUsage> &spriteUsage(quint8 sprite) const { return sprites[sprite]; }
+    QList<int> tileLevels(quint8 tile) const;
+    QList<int> spriteLevels(quint8 sprite) const;
+    qint64 bytes() const;
+
+private:
+    void scanLevel(const QDKLevel &level, int id, QVector<QDKUsage> *levelTiles, QVector<QDKUsage> *levelSprites);
+    void replaceLevel(QVector<QDKUsage> *list, QVector<quint16> *counts, int key, int id, const QVector<QDKUsage> &items);
+    QList<int> levelsOf(const QVector<quint16> &counts, int key) const;
+
+    QVector<QDKUsage> tiles[256];
+    QVector<QDKUsage> sprites[256];
+    QVector<quint16> tileCounts; // entries per id and level, id * MAX_LEVEL_ID + level
+    QVector<quint16> spriteCounts;
+};
+
+#endif // QDKUSAGEINDEX_H
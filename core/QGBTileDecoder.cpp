@@ -0,0 +1,31 @@
+#include "QGBTileDecoder.h"
+
+uchar QGBTileDecoder::planeTable[256][8];
+
+// fill the lookup table before anything gets decoded
+struct QGBTileDecoderInit
+{
+    QGBTileDecoderInit()
+    {
+        for (int value = 0; value < 256; value++)
+            for (int j = 0; j < 8; j++)
+                QGBTileDecoder::planeTable[value][j] = (value >> (7 - j)) & 0x01;
+    }
+};
+
+static QGBTileDecoderInit tableInit;
+
+void QGBTileDecoder::decodeTile(const uchar *src, uchar *pixels, int width, int height, int bytesPerLine, int x, int y)
+{
+    if ((x < 0) || (y < 0) || (x + 8 > width) || (y + 8 > height))
+        return;
+
+    decodeTile(src, pixels + y * bytesPerLine + x, bytesPerLine);
+}
+
+void QGBTileDecoder::padTileData(QByteArray *data, int count)
+{
+    // QDataStream used to return zeros when reading past the end
+    if (data->size() < count)
+        data->append(QByteArray(count - data->size(), (char)0x00));
+}
@@ -0,0 +1,52 @@
+#ifndef QGBTILEDECODER_H
+#define QGBTILEDECODER_H
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QByteArray>
+
+#include <string.h>
+
+// Gameboy 2bpp tile format:
+// every row of 8 pixels is stored as two bytes (low and high bit plane)
+// bit 7 is the leftmost pixel; colour index = (high << 1) | low
+#define GB_TILE_BYTES 0x10
+
+class QGBTileDecoder
+{
+public:
+    // decode one row into 8 colour indices
+    static inline void decodeRow(quint8 low, quint8 high, uchar *dst)
+    {
+        quint64 l, h;
+        memcpy(&l, planeTable[low], 8);
+        memcpy(&h, planeTable[high], 8);
+
+        // every byte holds 0 or 1 so this can't carry into the next pixel
+        l |= h << 1;
+        memcpy(dst, &l, 8);
+    }
+
+    // decode a 8x8 tile (16 bytes) into an 8bit buffer
+    static inline void decodeTile(const uchar *src, uchar *dst, int bytesPerLine)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            decodeRow(src[0], src[1], dst);
+            src += 2;
+            dst += bytesPerLine;
+        }
+    }
+
+    // decode a tile into an 8bit buffer of width x height pixels at pixel position x, y
+    static void decodeTile(const uchar *src, uchar *pixels, int width, int height, int bytesPerLine, int x, int y);
+
+    // make sure at least count bytes can be read from data
+    static void padTileData(QByteArray *data, int count);
+
+private:
+    // one byte per pixel for every possible bit plane value
+    static uchar planeTable[256][8];
+    friend struct QGBTileDecoderInit;
+};
+
+#endif // QGBTILEDECODER_H
@@ -0,0 +1,23 @@
+#ifndef QSPRITE_H
+#define QSPRITE_H
+
+#include <QtCore/QPointF>
+#include <QtCore/QSize>
+
+class QPixmap;
+
+enum { BOTTOM = 0, FLIPPED = 1, TOP = 2, LEFT = 3, RIGHT = 4 };
+
+struct QSprite
+{
+    bool pixelPerfect;
+    int x, y;
+    QSize size;
+    QPointF drawOffset;
+    QPixmap *sprite; // only set by the editor
+    int rotate;
+    int id;
+    quint8 flagByte;    
+};
+
+#endif // QSPRITE_H
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# eDKit core
+# rom parsing, level codecs, tile decoding and VRAM analysis
+# without any widgets - only needs QtCore
+#
+#-------------------------------------------------
+
+QT       -= gui
+QT       += core
+
+TARGET = eDKitCore
+TEMPLATE = lib
+CONFIG   += staticlib
+
+SOURCES += QDKRom.cpp\
+        QGBTileDecoder.cpp\
+        QDKTrace.cpp\
+        QDKUsageIndex.cpp
+
+HEADERS  += QDKRom.h\
+        QSprite.h\
+        QGBTileDecoder.h\
+        QDKTrace.h\
+        QDKUsageIndex.h
@@ -1,26 +1,18 @@
 #-------------------------------------------------
 #
-# Project created by QtCreator 2014-01-31T20:08:43
+# eDKit
+# core:       QtCore only rom and level library
+# editor:     the level editor
+# benchmarks: see benchmarks/main.cpp
+# cli:        headless rom builds, see cli/main.cpp
 #
 #-------------------------------------------------
 
-QT       += core gui
+TEMPLATE = subdirs
 
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+SUBDIRS = core editor benchmarks cli
 
-TARGET = eDKit
-TEMPLATE = app
-
-
-SOURCES += main.cpp\
-        MainWindow.cpp\
-        QTileEdit.cpp\
-        QTileSelector.cpp\
-        QDKEdit.cpp
-
-HEADERS  += MainWindow.h\
-        QTileEdit.h\
-        QTileSelector.h\
-        QDKEdit.h
-
-FORMS    += MainWindow.ui
+editor.file = editor.pro
+editor.depends = core
+benchmarks.depends = core
+cli.depends = core
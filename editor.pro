@@ -0,0 +1,45 @@
+#-------------------------------------------------
+#
+# Project created by QtCreator 2014-01-31T20:08:43
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
+TARGET = eDKit
+TEMPLATE = app
+
+
+SOURCES += main.cpp\
+        MainWindow.cpp\
+        QTileEdit.cpp\
+        QTileSelector.cpp\
+        QDKEdit.cpp\
+        QDKAssetCache.cpp\
+        QDKJournal.cpp\
+        QDKMemoryDialog.cpp\
+        QDKUsageDialog.cpp\
+        QDKReplaceDialog.cpp
+
+HEADERS  += MainWindow.h\
+        QTileEdit.h\
+        QTileSelector.h\
+        QDKEdit.h\
+        QDKAssetCache.h\
+        QDKJournal.h\
+        QDKMemoryDialog.h\
+        QDKUsageDialog.h\
+        QDKReplaceDialog.h
+
+FORMS    += MainWindow.ui
+
+INCLUDEPATH += $$PWD/core
+DEPENDPATH += $$PWD/core
+
+win32:CONFIG(release, debug|release): LIBS += -L$$OUT_PWD/core/release/ -leDKitCore
+else:win32:CONFIG(debug, debug|release): LIBS += -L$$OUT_PWD/core/debug/ -leDKitCore
+else:unix: LIBS += -L$$OUT_PWD/core/ -leDKitCore
+
+unix: PRE_TARGETDEPS += $$OUT_PWD/core/libeDKitCore.a
@@ -2,19 +2,32 @@
 #include <QMessageBox>
 #include <QtCore/QFile>
 #include "MainWindow.h"
+#include "QDKTrace.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    int traceArg = a.arguments().indexOf(TRACE_ARGUMENT);
+    if ((traceArg > 0) && (traceArg + 1 < a.arguments().size()))
+        QDKTrace::enable(a.arguments().at(traceArg + 1));
+
     if (!QFile::exists(qApp->applicationDirPath() + "/" BASE_ROM))
     {
         QMessageBox::warning(NULL, "Error", "You need a base.gb in the editor's directory!");
         return 1;
     }
 
-    MainWindow w;
-    w.show();
-    
-    return a.exec();
+    int result;
+
+    // the window is gone before writing, so the spans of its teardown are in the trace
+    {
+        MainWindow w;
+        w.show();
+
+        result = a.exec();
+    }
+    QDKTrace::write();
+
+    return result;
 }